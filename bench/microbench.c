@@ -0,0 +1,171 @@
+/* Copyright (C) 2008-2009 tks
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/* microbench times un-premultiplying and PNG encoding of libxcur2png in
+ * isolation, without reading Xcursors or writing files. */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "libxcur2png-private.h"
+#include "synth.h"
+
+static double benchClock (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void benchUnpremultiply (const unsigned char *argb, int npix,
+                                double duration)
+{ /* un-premultiply npix pixels again and again for duration seconds. */
+  unsigned char *dst = malloc ((size_t) npix * 4);
+  double start, elapsed;
+  long rounds = 0;
+  if (!dst)
+  {
+    fprintf (stderr, "Cannot allocate pixels!\n");
+    exit (1);
+  }
+  start = benchClock ();
+  do
+  {
+    unpremultiplyPixels (dst, argb, npix);
+    ++rounds;
+    elapsed = benchClock () - start;
+  } while (elapsed < duration);
+  printf ("%-20s %12.1f Mpixels/s %9.1f MB/s\n", "unpremultiply",
+          rounds * (double) npix / elapsed / 1e6,
+          rounds * (double) npix * 4 / elapsed / 1e6);
+  free (dst);
+  return;
+}
+
+static void benchEncode (const char *name, convContext *ctx,
+                         const unsigned char *rgba, int width, int height,
+                         const xcur2pngOptions *options, double duration)
+{ /* encode one image again and again for duration seconds. */
+  double start, elapsed;
+  long rounds = 0;
+  start = benchClock ();
+  do
+  {
+    if (encodeImage (ctx, rgba, width, height, (size_t) width * 4, options)
+        == -1)
+    {
+      fprintf (stderr, "%s: cannot encode image!\n", name);
+      exit (1);
+    }
+    ++rounds;
+    elapsed = benchClock () - start;
+  } while (elapsed < duration);
+  printf ("%-20s %12.1f images/s  %9.1f MB/s %9lu bytes\n", name,
+          rounds / elapsed, rounds * (double) width * height * 4 / elapsed / 1e6,
+          (unsigned long) ctx->pngLen);
+  return;
+}
+
+int main (int argc, char **argv)
+{
+  int size = 64, alpha = SYNTH_ALPHA_SMOOTH;
+  double duration = 1.0;
+  XcursorPixel *argb, *big;
+  unsigned char *rgba;
+  xcur2pngOptions options;
+  convContext ctx;
+  int opt, i;
+
+  while ((opt = getopt (argc, argv, "s:a:t:h")) != -1)
+  {
+    switch (opt)
+    {
+      case 's':
+      {
+        char *end;
+        long value = strtol (optarg, &end, 10);
+        if (end == optarg || *end != '\0' || value < 1 || value > 1024)
+        {
+          fprintf (stderr, "size must be 1 to 1024!\n");
+          exit (2);
+        }
+        size = value;
+        break;
+      }
+      case 'a':
+        alpha = synthAlphaByName (optarg);
+        if (alpha == -1)
+        {
+          fprintf (stderr, "Unknown alpha distribution \"%s\"!\n", optarg);
+          exit (2);
+        }
+        break;
+      case 't':
+      {
+        char *end;
+        duration = strtod (optarg, &end);
+        if (end == optarg || *end != '\0' || !(duration > 0))
+        {
+          fprintf (stderr, "seconds must be positive!\n");
+          exit (2);
+        }
+        break;
+      }
+      default:
+        fprintf (stderr, "Usage: %s [-s SIZE] [-a ALPHA] [-t SECONDS]\n",
+                 argv[0]);
+        exit (opt == 'h' ? 0 : 2);
+    }
+  }
+
+  initConvContext (&ctx);
+  argb = malloc ((size_t) size * size * sizeof (XcursorPixel));
+  /* 256 frames of 64x64 is larger than L1 and L2 caches of most CPUs. */
+  big = malloc ((size_t) 256 * 64 * 64 * sizeof (XcursorPixel));
+  rgba = malloc ((size_t) size * size * 4);
+  if (!argb || !big || !rgba || !reserveConvContext (&ctx, size, size))
+  {
+    fprintf (stderr, "Cannot allocate pixels!\n");
+    exit (1);
+  }
+  synthImage (argb, size, size, 0, alpha, 1);
+  for (i = 0; i < 256; ++i)
+    synthImage (big + i * 64 * 64, 64, 64, i, alpha, 1);
+  unpremultiplyPixels (rgba, (unsigned char *) argb, size * size);
+
+  printf ("alpha %s, %dx%d images, %.1f seconds each\n",
+          synthAlphaName (alpha), size, size, duration);
+  benchUnpremultiply ((unsigned char *) big, 256 * 64 * 64, duration);
+  xcur2pngInitOptions (&options);
+  benchEncode ("png", &ctx, rgba, size, size, &options, duration);
+  options.keepRgba = 1;
+  benchEncode ("png rgba", &ctx, rgba, size, size, &options, duration);
+  options.keepRgba = 0;
+  options.zlibLevel = 1;
+  benchEncode ("png level 1", &ctx, rgba, size, size, &options, duration);
+  options.zlibLevel = -1;
+  options.format = XCUR2PNG_FORMAT_QOI;
+  benchEncode ("qoi", &ctx, rgba, size, size, &options, duration);
+
+  freeConvContext (&ctx);
+  free (rgba);
+  free (big);
+  free (argb);
+  return 0;
+}
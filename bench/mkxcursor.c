@@ -0,0 +1,177 @@
+/* Copyright (C) 2008-2009 tks
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/* mkxcursor writes a synthetic Xcursor through libXcursor for benchmarks
+ * and tests. */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include <X11/Xcursor/Xcursor.h>
+#include "synth.h"
+
+#define MAX_SIZES 16
+
+static void printUsage (const char *prog)
+{
+  fprintf (stderr, "Usage: %s [options] XCURSOR\n", prog);
+  fprintf (stderr, "  -s, --sizes [s,s,...]  nominal sizes. (default 24,32,48)\n");
+  fprintf (stderr, "  -n, --frames [n]       frames of each size. (default 1)\n");
+  fprintf (stderr, "  -a, --alpha [kind]     opaque, binary, smooth or random.\n");
+  fprintf (stderr, "                         (default smooth)\n");
+  fprintf (stderr, "  -r, --seed [n]         seed of random alpha. (default 1)\n");
+  fprintf (stderr, "  -d, --delay [ms]       delay of each frame. (default 50)\n");
+  return;
+}
+
+static long parseNumber (const char *arg, long min, long max, const char *what)
+{ /* return arg as number in [min, max], or exit with 2 if it is not. */
+  char *end;
+  long value;
+  errno = 0;
+  value = strtol (arg, &end, 10);
+  if (errno || end == arg || *end != '\0' || value < min || value > max)
+  {
+    fprintf (stderr, "%s must be %ld to %ld!\n", what, min, max);
+    exit (2);
+  }
+  return value;
+}
+
+int main (int argc, char **argv)
+{
+  static struct option longOptions[] = {
+    {"sizes",  required_argument, NULL, 's'},
+    {"frames", required_argument, NULL, 'n'},
+    {"alpha",  required_argument, NULL, 'a'},
+    {"seed",   required_argument, NULL, 'r'},
+    {"delay",  required_argument, NULL, 'd'},
+    {"help",   no_argument,       NULL, 'h'},
+    {0, 0, 0, 0}
+  };
+  int sizes[MAX_SIZES] = {24, 32, 48};
+  int nsizes = 3;
+  long frames = 1, seed = 1, delay = 50;
+  int alpha = SYNTH_ALPHA_SMOOTH;
+  XcursorImages *images;
+  int opt, i, f;
+
+  while ((opt = getopt_long (argc, argv, "s:n:a:r:d:h", longOptions, NULL))
+         != -1)
+  {
+    switch (opt)
+    {
+      case 's':
+      {
+        char *copy = strdup (optarg), *token, *save;
+        if (!copy)
+        {
+          perror (argv[0]);
+          exit (1);
+        }
+        nsizes = 0;
+        for (token = strtok_r (copy, ",", &save); token;
+             token = strtok_r (NULL, ",", &save))
+        {
+          if (nsizes == MAX_SIZES)
+          {
+            fprintf (stderr, "Too many sizes!\n");
+            exit (2);
+          }
+          sizes[nsizes++] = parseNumber (token, 1, 1024, "size");
+        }
+        free (copy);
+        if (nsizes == 0)
+        {
+          fprintf (stderr, "No size is given!\n");
+          exit (2);
+        }
+        break;
+      }
+      case 'n':
+        frames = parseNumber (optarg, 1, 1000000, "frames");
+        break;
+      case 'a':
+        alpha = synthAlphaByName (optarg);
+        if (alpha == -1)
+        {
+          fprintf (stderr, "Unknown alpha distribution \"%s\"!\n", optarg);
+          exit (2);
+        }
+        break;
+      case 'r':
+        seed = parseNumber (optarg, 0, 0x7fffffff, "seed");
+        break;
+      case 'd':
+        delay = parseNumber (optarg, 0, 0x7fffffff, "delay");
+        break;
+      case 'h':
+        printUsage (argv[0]);
+        exit (0);
+      default:
+        printUsage (argv[0]);
+        exit (2);
+    }
+  }
+  if (argc - optind != 1)
+  {
+    printUsage (argv[0]);
+    exit (2);
+  }
+  if (frames > 1000000 / nsizes)
+  {
+    fprintf (stderr, "Too many images!\n");
+    exit (2);
+  }
+
+  images = XcursorImagesCreate (nsizes * frames);
+  if (!images)
+  {
+    fprintf (stderr, "Cannot allocate images!\n");
+    exit (1);
+  }
+  /* images of each size are consecutive, as xcursorgen writes them. */
+  for (i = 0; i < nsizes; ++i)
+  {
+    for (f = 0; f < frames; ++f)
+    {
+      XcursorImage *image = XcursorImageCreate (sizes[i], sizes[i]);
+      if (!image)
+      {
+        fprintf (stderr, "Cannot allocate images!\n");
+        XcursorImagesDestroy (images);
+        exit (1);
+      }
+      image->size = sizes[i];
+      image->xhot = sizes[i] / 4;
+      image->yhot = sizes[i] / 4;
+      image->delay = delay;
+      synthImage (image->pixels, sizes[i], sizes[i], f, alpha, seed);
+      images->images[images->nimage++] = image;
+    }
+  }
+  if (!XcursorFilenameSaveImages (argv[optind], images))
+  {
+    fprintf (stderr, "Cannot write %s!\n", argv[optind]);
+    XcursorImagesDestroy (images);
+    exit (1);
+  }
+  XcursorImagesDestroy (images);
+  return 0;
+}
@@ -0,0 +1,216 @@
+/* Copyright (C) 2008-2009 tks
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/* runbench runs xcur2png end to end on Xcursors and reports frames/s,
+ * MB/s of pixels and peak RSS of each. */
+
+#include <config.h>
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <X11/Xcursor/Xcursor.h>
+
+static void printUsage (const char *prog)
+{
+  fprintf (stderr, "Usage: %s [-x XCUR2PNG] [-n RUNS] XCURSOR... "
+                   "[-- OPTION...]\n", prog);
+  fprintf (stderr, "  -x  xcur2png to run. (default ../xcur2png)\n");
+  fprintf (stderr, "  -n  runs of each Xcursor. the fastest is reported."
+                   " (default 3)\n");
+  fprintf (stderr, "  OPTIONs after -- are passed to xcur2png.\n");
+  return;
+}
+
+static double now (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int removeEntry (const char *path, const struct stat *sb, int flag,
+                        struct FTW *ftwbuf)
+{
+  return remove (path);
+}
+
+static int runOnce (char **args, double *seconds, long *maxrss)
+{ /* run args with stdout to /dev/null. return 1 if it exits with 0. */
+  struct rusage usage;
+  double start = now ();
+  int status;
+  pid_t pid = fork ();
+  if (pid == -1)
+  {
+    perror ("fork");
+    return 0;
+  }
+  if (pid == 0)
+  {
+    int fd = open ("/dev/null", O_WRONLY);
+    if (fd != -1)
+      dup2 (fd, 1);
+    execv (args[0], args);
+    perror (args[0]);
+    _exit (127);
+  }
+  if (wait4 (pid, &status, 0, &usage) == -1)
+  {
+    perror ("wait4");
+    return 0;
+  }
+  *seconds = now () - start;
+  *maxrss = usage.ru_maxrss;
+  return WIFEXITED (status) && WEXITSTATUS (status) == 0;
+}
+
+static int benchXcursor (const char *prog, const char *file, int runs,
+                         char **options, int noptions)
+{ /* return 1 if every run succeeds. */
+  XcursorImages *images = XcursorFilenameLoadAllImages (file);
+  double pixelBytes = 0, best = 0;
+  long peak = 0;
+  char **args;
+  int i, n = 0, ok = 1;
+
+  if (!images)
+  {
+    fprintf (stderr, "%s is not Xcursor!\n", file);
+    return 0;
+  }
+  for (i = 0; i < images->nimage; ++i)
+    pixelBytes += (double) images->images[i]->width
+                  * images->images[i]->height * 4;
+  args = malloc ((noptions + 8) * sizeof (char *));
+  if (!args)
+  {
+    XcursorImagesDestroy (images);
+    fprintf (stderr, "Cannot allocate arguments!\n");
+    return 0;
+  }
+  for (i = 0; i < runs && ok; ++i)
+  {
+    char dir[] = "runbench.XXXXXX";
+    double seconds;
+    long maxrss;
+    if (!mkdtemp (dir))
+    {
+      perror ("mkdtemp");
+      ok = 0;
+      break;
+    }
+    n = 0;
+    args[n++] = (char *) prog;
+    args[n++] = "-q";
+    args[n++] = "-c";
+    args[n++] = dir;
+    args[n++] = "-d";
+    args[n++] = dir;
+    memcpy (args + n, options, noptions * sizeof (char *));
+    n += noptions;
+    args[n++] = (char *) file;
+    args[n] = NULL;
+    if (!runOnce (args, &seconds, &maxrss))
+    {
+      fprintf (stderr, "%s failed on %s!\n", prog, file);
+      ok = 0;
+    }
+    else
+    {
+      if (i == 0 || seconds < best)
+        best = seconds;
+      if (maxrss > peak)
+        peak = maxrss;
+    }
+    nftw (dir, removeEntry, 16, FTW_DEPTH | FTW_PHYS);
+  }
+  if (ok)
+    printf ("%-24s %7d %9.2f %9.4f %11.1f %9.1f %9ld\n", file,
+            images->nimage, pixelBytes / 1e6, best,
+            images->nimage / best, pixelBytes / 1e6 / best, peak);
+  free (args);
+  XcursorImagesDestroy (images);
+  return ok;
+}
+
+int main (int argc, char **argv)
+{
+  const char *prog = "../xcur2png";
+  char **options = NULL;
+  int noptions = 0, nfiles, runs = 3;
+  int opt, i, ret = 0;
+
+  while ((opt = getopt (argc, argv, "+x:n:h")) != -1)
+  {
+    switch (opt)
+    {
+      case 'x':
+        prog = optarg;
+        break;
+      case 'n':
+      {
+        char *end;
+        long value = strtol (optarg, &end, 10);
+        if (end == optarg || *end != '\0' || value < 1 || value > 1000)
+        {
+          fprintf (stderr, "runs must be 1 to 1000!\n");
+          exit (2);
+        }
+        runs = value;
+        break;
+      }
+      case 'h':
+        printUsage (argv[0]);
+        exit (0);
+      default:
+        printUsage (argv[0]);
+        exit (2);
+    }
+  }
+  for (nfiles = 0; optind + nfiles < argc; ++nfiles)
+  {
+    if (strcmp (argv[optind + nfiles], "--") == 0)
+    {
+      options = argv + optind + nfiles + 1;
+      noptions = argc - optind - nfiles - 1;
+      break;
+    }
+  }
+  if (nfiles == 0)
+  {
+    printUsage (argv[0]);
+    exit (2);
+  }
+
+  printf ("%-24s %7s %9s %9s %11s %9s %9s\n", "Xcursor", "frames",
+          "MB", "seconds", "frames/s", "MB/s", "RSS KB");
+  for (i = 0; i < nfiles; ++i)
+  {
+    if (!benchXcursor (prog, argv[optind + i], runs, options, noptions))
+      ret = 1;
+  }
+  return ret;
+}
@@ -0,0 +1,107 @@
+/* Copyright (C) 2008-2009 tks
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <config.h>
+
+#include <string.h>
+#include <math.h>
+#include "synth.h"
+
+static const char *alphaNames[] = {"opaque", "binary", "smooth", "random"};
+
+int synthAlphaByName (const char *name)
+{ /* return SYNTH_ALPHA_* of name, or -1 if name is unknown. */
+  int i;
+  for (i = 0; i < (int) (sizeof (alphaNames) / sizeof (alphaNames[0])); ++i)
+  {
+    if (strcmp (name, alphaNames[i]) == 0)
+      return i;
+  }
+  return -1;
+}
+
+const char *synthAlphaName (int alpha)
+{
+  return alphaNames[alpha];
+}
+
+static unsigned int nextRandom (unsigned int *state)
+{ /* xorshift32. same sequence on every platform, unlike rand(3). */
+  unsigned int x = *state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  *state = x;
+  return x;
+}
+
+void synthImage (XcursorPixel *pixels, int width, int height, int frame,
+                 int alpha, unsigned int seed)
+{ /* fill width x height premultiplied ARGB pixels of frame-th image.
+   * colors move with frame, so the first 65536 frames are all different
+   * unless alpha is 0 everywhere. */
+  double radius = (width < height ? width : height) * 0.4;
+  double cx = width / 2.0 + (frame % 8 - 4) * width / 64.0;
+  double cy = height / 2.0;
+  unsigned int state = seed * 2654435761u + frame + 1;
+  int x, y;
+  for (y = 0; y < height; ++y)
+  {
+    for (x = 0; x < width; ++x)
+    {
+      double d = sqrt ((x + 0.5 - cx) * (x + 0.5 - cx) +
+                       (y + 0.5 - cy) * (y + 0.5 - cy));
+      unsigned int r = (x * 255 / width + frame * 7 + (frame >> 8) * 3)
+                       & 0xff;
+      unsigned int g = (y * 255 / height + frame * 13) & 0xff;
+      unsigned int b = ((x + y) * 4 + frame * 29) & 0xff;
+      unsigned int a;
+      switch (alpha)
+      {
+        case SYNTH_ALPHA_OPAQUE:
+          a = 255;
+          break;
+        case SYNTH_ALPHA_BINARY:
+          a = d < radius ? 255 : 0;
+          break;
+        case SYNTH_ALPHA_SMOOTH:
+        { /* coverage of a one pixel wide edge, over a shadow which fades
+           * out in three pixels. shadow is black. */
+          double cover = radius - d + 0.5;
+          double shadow = 1.0 - (d - radius) / 3.0;
+          cover = cover < 0 ? 0 : cover > 1 ? 1 : cover;
+          shadow = shadow < 0 ? 0 : shadow > 1 ? 1 : shadow;
+          a = (unsigned int) (cover * 255 + (1 - cover) * shadow * 80 + 0.5);
+          if (a && cover < 1)
+          {
+            r = (unsigned int) (r * cover * 255 / a);
+            g = (unsigned int) (g * cover * 255 / a);
+            b = (unsigned int) (b * cover * 255 / a);
+          }
+          break;
+        }
+        default:
+          a = nextRandom (&state) & 0xff;
+          break;
+      }
+      r = (r * a + 127) / 255;
+      g = (g * a + 127) / 255;
+      b = (b * a + 127) / 255;
+      pixels[y * width + x] = (a << 24) | (r << 16) | (g << 8) | b;
+    }
+  }
+  return;
+}
@@ -0,0 +1,37 @@
+/* Copyright (C) 2008-2009 tks
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/* synth makes synthetic cursor images for benchmarks and tests. */
+
+#ifndef SYNTH_H
+#define SYNTH_H
+
+#include <X11/Xcursor/Xcursor.h>
+
+/* how alpha of synthetic images is distributed. */
+enum SYNTH_ALPHA {
+  SYNTH_ALPHA_OPAQUE = 0,   /* alpha is 255 everywhere. */
+  SYNTH_ALPHA_BINARY,       /* a disc of 255 on 0. */
+  SYNTH_ALPHA_SMOOTH,       /* anti-aliased disc with a shadow, like
+                               most real cursors. */
+  SYNTH_ALPHA_RANDOM        /* every pixel has random alpha. */
+};
+
+int synthAlphaByName (const char *name);
+const char *synthAlphaName (int alpha);
+void synthImage (XcursorPixel *pixels, int width, int height, int frame,
+                 int alpha, unsigned int seed);
+
+#endif /* SYNTH_H */
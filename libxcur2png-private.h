@@ -0,0 +1,80 @@
+/* Copyright (C) 2008-2009 tks
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/* Low level API of libxcur2png used by xcur2png command, tests and
+ * benchmarks. This header is not installed, so layout of the structures
+ * and these functions may change without notice. */
+
+#ifndef LIBXCUR2PNG_PRIVATE_H
+#define LIBXCUR2PNG_PRIVATE_H
+
+#include "libxcur2png.h"
+
+typedef struct {
+  const unsigned char *data;  /* whole Xcursor file. */
+  size_t length;              /* length of data. */
+  int mapped;                 /* 1 if data is mmapped by caller. set by
+                                 caller before parseXcursor. */
+  int nimage;                 /* number of selected image chunks. */
+  size_t *positions;          /* position of each image chunk in data. */
+} xcurFile ;
+
+typedef struct {
+  unsigned char *pix;   /* non-premultiplied RGBA pixels of an image. */
+  size_t pixSize;       /* allocated number of pixels in pix. */
+  unsigned char **rows; /* row pointers passed to libpng. */
+  size_t rowsSize;      /* allocated number of pointers in rows. */
+  unsigned char *packed;  /* pixels packed to reduced PNG color type. */
+  size_t packedSize;    /* allocated bytes of packed. */
+  unsigned char *png;   /* encoded image. PNG unless options->format. */
+  size_t pngLen;        /* length of encoded image. */
+  size_t pngSize;       /* allocated bytes of png. */
+  unsigned char *prev;  /* previous frame of APNG. */
+  size_t prevSize;      /* allocated bytes of prev. */
+  unsigned char *apng;  /* APNG which is written to file. */
+  size_t apngLen;       /* length of APNG. */
+  size_t apngSize;      /* allocated bytes of apng. */
+  int allocations;      /* number of times buffers were (re)allocated. */
+  size_t peakBytes;     /* total bytes of buffers. they never shrink. */
+} convContext ;
+
+void initConvContext (convContext *ctx);
+void freeConvContext (convContext *ctx);
+int reserveConvContext (convContext *ctx, XcursorDim width, XcursorDim height);
+int growBuffer (convContext *ctx, unsigned char **buf, size_t *size,
+                size_t need);
+int encodePng (convContext *ctx, const unsigned char *pix,
+               const XcursorDim width, const XcursorDim height, size_t stride,
+               const xcur2pngOptions *options);
+int encodeImage (convContext *ctx, const unsigned char *pix,
+                 const XcursorDim width, const XcursorDim height, size_t stride,
+                 const xcur2pngOptions *options);
+int encodeXcursorImage (convContext *ctx, const xcurImage *image,
+                        const xcur2pngOptions *options);
+void unpremultiplyPixels (unsigned char *dst, const unsigned char *src, int n);
+int parseXcursor (xcurFile *xf, const unsigned char *data, size_t length,
+                  const xcur2pngOptions *options);
+void freeXcursor (xcurFile *xf);
+void getXcursorImage (const xcurFile *xf, int index, xcurImage *image);
+void releaseXcursorImage (const xcurFile *xf, const xcurImage *image);
+uint64_t hashImage (const xcurImage *image);
+/* length of digest which digestImage writes. */
+#define IMAGE_DIGEST_LENGTH 32
+void digestImage (const xcurImage *image, unsigned char *digest);
+int sameImage (const xcurImage *a, const xcurImage *b);
+int planXcursor (const xcurFile *xf, int dedupe, xcur2pngEntry **entriesp,
+                 int *nentryp, int **imagesp, int *npngp);
+
+#endif /* LIBXCUR2PNG_PRIVATE_H */
@@ -0,0 +1,1194 @@
+/* Copyright (C) 2008-2009 tks
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <pthread.h>
+#include <setjmp.h>
+/* Need to use libpng > ver 1.0.6 */
+#include <png.h>
+#include "libxcur2png-private.h"
+
+/* palette PNG of which other than PLTE and tRNS is smaller than this is
+ * encoded with other color type too, because PLTE and tRNS may be larger
+ * than what palette saves. */
+#define PALETTE_RETRY_MAX 1024
+/* the largest PLTE and tRNS. */
+#define PALETTE_CHUNKS_MAX (12 + 3 * 256 + 12 + 256)
+
+/* unpremultiplyTable[alpha][value] is non-premultiplied value.
+ * Set once by initUnpremultiplyTable, and never changed after that. */
+static unsigned char unpremultiplyTable[256][256];
+static pthread_once_t unpremultiplyOnce = PTHREAD_ONCE_INIT;
+
+static void initUnpremultiplyTable (void);
+static void writePngData (png_structp png_ptr, png_bytep data,
+                          png_size_t length);
+static void flushPngData (png_structp png_ptr);
+typedef struct {
+  int colorType;          /* PNG_COLOR_TYPE_* chosen for an image. */
+  int bitDepth;
+  png_color palette[256];
+  png_byte trans[256];    /* alpha of each palette entry. */
+  int npalette;
+  int ntrans;             /* palette entries from this are opaque. */
+  size_t rowBytes;        /* bytes of a row in packed buffer. */
+} pngColors ;
+
+static int reducePngColors (convContext *ctx, const unsigned char *pix,
+                            XcursorDim width, XcursorDim height,
+                            size_t stride, int palette, pngColors *colors);
+static int writePng (convContext *ctx, const unsigned char *pix,
+                     XcursorDim width, XcursorDim height, size_t stride,
+                     const xcur2pngOptions *options, const pngColors *colors);
+static int encodeQoi (convContext *ctx, const unsigned char *pix,
+                      XcursorDim width, XcursorDim height, size_t stride);
+static int encodeRaw (convContext *ctx, const unsigned char *pix,
+                      XcursorDim width, XcursorDim height, size_t stride,
+                      int pam);
+static XcursorUInt readUInt (const unsigned char *p);
+static int reportProblem (void (*problem) (void *closure,
+                                            const char *message),
+                          void *closure, const char *format, ...);
+static int imageIsSelected (XcursorDim size, int frame,
+                            const xcur2pngOptions *options);
+static void releaseData (const xcurFile *xf, const unsigned char *p,
+                         size_t length);
+
+void xcur2pngInitOptions (xcur2pngOptions *options)
+{ /* set default options: libpng default compression, all images and
+   * no dedupe. */
+  memset (options, 0, sizeof (xcur2pngOptions));
+  options->zlibLevel = -1;
+  options->zlibStrategy = -1;
+  options->pngFilters = -1;
+  options->lastFrame = -1;
+  return;
+}
+
+int xcur2pngConvert (const unsigned char *data, size_t length,
+                     const xcur2pngOptions *options,
+                     const xcur2pngCallbacks *callbacks, void *closure)
+{ /* convert Xcursor in data to PNGs and entries of config-file, and pass
+   * them to callbacks. return XCUR2PNG_OK if success. */
+  xcurFile xf;
+  xcurImage image;
+  convContext ctx;
+  xcur2pngEntry *entries = NULL;
+  int *images = NULL;
+  int nentry = 0, npng = 0;
+  int ret, i;
+
+  xf.mapped = 0;
+  if (!parseXcursor (&xf, data, length, options))
+    return XCUR2PNG_EINVALID;
+  ret = planXcursor (&xf, options->dedupe, &entries, &nentry, &images, &npng);
+  for (i = 0; ret == XCUR2PNG_OK && i < nentry; ++i)
+  {
+    if (callbacks->entry && callbacks->entry (closure, entries + i) != 0)
+      ret = XCUR2PNG_ECALLBACK;
+  }
+  initConvContext (&ctx);
+  for (i = 0; ret == XCUR2PNG_OK && i < npng; ++i)
+  {
+    getXcursorImage (&xf, images[i], &image);
+    ret = encodeXcursorImage (&ctx, &image, options);
+    if (ret == XCUR2PNG_OK && callbacks->png &&
+        callbacks->png (closure, i, &image, ctx.png, ctx.pngLen) != 0)
+      ret = XCUR2PNG_ECALLBACK;
+  }
+  freeConvContext (&ctx);
+  free (entries);
+  free (images);
+  freeXcursor (&xf);
+  return ret;
+}
+
+const char *xcur2pngStrerror (int error)
+{
+  switch (error)
+  {
+    case XCUR2PNG_OK:
+      return "Success";
+    case XCUR2PNG_EINVALID:
+      return "Not a valid Xcursor";
+    case XCUR2PNG_EVERSION:
+      return "xcur2png can only retrieve Xcursor version 1.";
+    case XCUR2PNG_ENOMEM:
+      return "Cannot allocate memory";
+    case XCUR2PNG_EPNG:
+      return "Cannot encode image";
+    case XCUR2PNG_ECALLBACK:
+      return "Stopped by callback";
+    default:
+      return "Unknown error";
+  }
+}
+
+const char *xcur2pngExtension (int format)
+{ /* return file name extension of format without dot. */
+  switch (format)
+  {
+    case XCUR2PNG_FORMAT_QOI:
+      return "qoi";
+    case XCUR2PNG_FORMAT_PAM:
+      return "pam";
+    case XCUR2PNG_FORMAT_RGBA:
+      return "rgba";
+    default:
+      return "png";
+  }
+}
+
+int planXcursor (const xcurFile *xf, int dedupe, xcur2pngEntry **entriesp,
+                 int *nentryp, int **imagesp, int *npngp)
+{ /* decide entries of config-file and images which are written to PNGs.
+   * (*imagesp)[p] is the image written to p-th PNG. If dedupe is 1,
+   * identical images share one PNG. Consecutive entries which differ
+   * only in delay are merged and their delays are summed.
+   * return XCUR2PNG_OK if success. */
+  int n, i;
+  int ret = XCUR2PNG_OK;
+  int nentry = 0, npng = 0;
+  xcur2pngEntry *entries;
+  int *images;
+  int *pngOf;         /* PNG number of each image. */
+  int *table = NULL;  /* hash table of images written to PNGs. */
+  uint64_t *hashes = NULL;
+  size_t tableSize = 1;
+  xcurImage image;
+  xcurImage other;
+
+  entries = malloc ((xf->nimage ? xf->nimage : 1) * sizeof (xcur2pngEntry));
+  images = malloc ((xf->nimage ? xf->nimage : 1) * sizeof (int));
+  pngOf = malloc ((xf->nimage ? xf->nimage : 1) * sizeof (int));
+  if (dedupe)
+  {
+    while (tableSize < 2 * (size_t) xf->nimage)
+      tableSize *= 2;
+    table = malloc (tableSize * sizeof (int));
+    hashes = malloc ((xf->nimage ? xf->nimage : 1) * sizeof (uint64_t));
+  }
+  if (!entries || !images || !pngOf || (dedupe && (!table || !hashes)))
+  {
+    free (entries);
+    free (images);
+    free (pngOf);
+    free (table);
+    free (hashes);
+    return XCUR2PNG_ENOMEM;
+  }
+  for (i = 0; dedupe && i < tableSize; ++i)
+    table[i] = -1;
+
+  for (n = 0; n < xf->nimage; ++n)
+  {
+    getXcursorImage (xf, n, &image);
+    if (image.version != 1)
+    {
+      ret = XCUR2PNG_EVERSION;
+      break;
+    }
+
+    pngOf[n] = -1;
+    if (dedupe)
+    { /* Look for same image which is already written. */
+      size_t slot;
+      hashes[n] = hashImage (&image);
+      for (slot = hashes[n] & (tableSize - 1); table[slot] != -1;
+           slot = (slot + 1) & (tableSize - 1))
+      {
+        getXcursorImage (xf, table[slot], &other);
+        if (hashes[table[slot]] == hashes[n] && sameImage (&image, &other))
+          pngOf[n] = pngOf[table[slot]];
+        releaseXcursorImage (xf, &other);
+        if (pngOf[n] != -1)
+          break;
+      }
+      if (pngOf[n] == -1)
+        table[slot] = n;
+    }
+    releaseXcursorImage (xf, &image);
+    if (pngOf[n] == -1)
+    {
+      pngOf[n] = npng;
+      images[npng++] = n;
+    }
+
+    if (nentry > 0 && entries[nentry - 1].png == pngOf[n] &&
+        entries[nentry - 1].size == image.size &&
+        entries[nentry - 1].xhot == image.xhot &&
+        entries[nentry - 1].yhot == image.yhot)
+    { /* same as previous frame. only delay is merged. */
+      entries[nentry - 1].delay += image.delay;
+      continue;
+    }
+    entries[nentry].size = image.size;
+    entries[nentry].xhot = image.xhot;
+    entries[nentry].yhot = image.yhot;
+    entries[nentry].delay = image.delay;
+    entries[nentry].png = pngOf[n];
+    ++nentry;
+  }
+  free (pngOf);
+  free (table);
+  free (hashes);
+  if (ret != XCUR2PNG_OK)
+  {
+    free (entries);
+    free (images);
+    return ret;
+  }
+  *entriesp = entries;
+  *nentryp = nentry;
+  *imagesp = images;
+  *npngp = npng;
+  return XCUR2PNG_OK;
+}
+
+void initConvContext (convContext *ctx)
+{ /* must be called before ctx is used. */
+  pthread_once (&unpremultiplyOnce, initUnpremultiplyTable);
+  memset (ctx, 0, sizeof (convContext));
+  return;
+}
+
+void freeConvContext (convContext *ctx)
+{
+  free (ctx->pix);
+  free (ctx->rows);
+  free (ctx->png);
+  free (ctx->prev);
+  free (ctx->apng);
+  free (ctx->packed);
+  memset (ctx, 0, sizeof (convContext));
+  return;
+}
+
+int reserveConvContext (convContext *ctx, XcursorDim width, XcursorDim height)
+{ /* grow buffers of ctx for width x height image. return 0 if fail. */
+  size_t npix = (size_t) width * height;
+  if (npix > ctx->pixSize)
+  {
+    unsigned char *pix = realloc (ctx->pix, npix * 4);
+    if (!pix)
+      return 0;
+    ctx->peakBytes += (npix - ctx->pixSize) * 4;
+    ctx->pix = pix;
+    ctx->pixSize = npix;
+    ++ctx->allocations;
+  }
+  if (height > ctx->rowsSize)
+  {
+    png_bytep *rows = realloc (ctx->rows, height * sizeof (png_bytep));
+    if (!rows)
+      return 0;
+    ctx->peakBytes += (height - ctx->rowsSize) * sizeof (png_bytep);
+    ctx->rows = rows;
+    ctx->rowsSize = height;
+    ++ctx->allocations;
+  }
+  ctx->pngLen = 0;
+  return 1;
+}
+
+int growBuffer (convContext *ctx, unsigned char **buf, size_t *size,
+                size_t need)
+{ /* grow *buf of ctx to need bytes at least. return 0 if fail. */
+  size_t newSize = *size ? *size : 4096;
+  unsigned char *p;
+  if (need <= *size)
+    return 1;
+  while (newSize < need)
+    newSize *= 2;
+  p = realloc (*buf, newSize);
+  if (!p)
+    return 0;
+  ctx->peakBytes += newSize - *size;
+  *buf = p;
+  *size = newSize;
+  ++ctx->allocations;
+  return 1;
+}
+
+static void writePngData (png_structp png_ptr, png_bytep data, png_size_t length)
+{ /* libpng write callback which appends data to png buffer of convContext. */
+  convContext *ctx = png_get_io_ptr (png_ptr);
+  if (!growBuffer (ctx, &ctx->png, &ctx->pngSize, ctx->pngLen + length))
+    png_error (png_ptr, "Cannot allocate PNG buffer");
+  memcpy (ctx->png + ctx->pngLen, data, length);
+  ctx->pngLen += length;
+  return;
+}
+
+static void flushPngData (png_structp png_ptr)
+{ /* nothing to do because data is kept in memory. */
+  return;
+}
+
+int encodePng (convContext *ctx, const unsigned char *pix,
+               const XcursorDim width, const XcursorDim height, size_t stride,
+               const xcur2pngOptions *options)
+{ /* encode width x height RGBA pixels to PNG in ctx->png. Rows of pix are
+   * stride bytes apart. Color type is reduced losslessly unless
+   * options->keepRgba. return 1 if success, -1 if fail. */
+  unsigned char saved[PALETTE_RETRY_MAX + PALETTE_CHUNKS_MAX];
+  pngColors colors;
+  size_t len, chunks;
+
+  colors.colorType = PNG_COLOR_TYPE_RGB_ALPHA;
+  colors.bitDepth = 8;
+  if (options->keepRgba)
+    return writePng (ctx, pix, width, height, stride, options, &colors);
+  if (!reducePngColors (ctx, pix, width, height, stride, 1, &colors) ||
+      writePng (ctx, pix, width, height, stride, options, &colors) == -1)
+    return -1;
+  if (colors.colorType != PNG_COLOR_TYPE_PALETTE)
+    return 1;
+  chunks = 12 + 3 * colors.npalette + (colors.ntrans ? 12 + colors.ntrans : 0);
+  if (ctx->pngLen >= PALETTE_RETRY_MAX + chunks)
+    return 1;
+  /* PLTE and tRNS of a tiny PNG may cost more than palette saves, so
+   * other color type is tried too and the smaller one is kept. */
+  len = ctx->pngLen;
+  memcpy (saved, ctx->png, len);
+  if (!reducePngColors (ctx, pix, width, height, stride, 0, &colors) ||
+      writePng (ctx, pix, width, height, stride, options, &colors) == -1)
+    return -1;
+  if (ctx->pngLen > len)
+  {
+    memcpy (ctx->png, saved, len);
+    ctx->pngLen = len;
+  }
+  return 1;
+}
+
+static void pngError (png_structp png_ptr, png_const_charp message)
+{ /* libpng's default handler prints message to stderr of the program
+   * which uses this library. Failure is returned by setjmp in writePng. */
+  longjmp (png_jmpbuf (png_ptr), 1);
+}
+
+static void pngWarning (png_structp png_ptr, png_const_charp message)
+{ /* warnings do not stop encoding, and are not printed either. */
+  return;
+}
+
+static int writePng (convContext *ctx, const unsigned char *pix,
+                     XcursorDim width, XcursorDim height, size_t stride,
+                     const xcur2pngOptions *options, const pngColors *colors)
+{ /* encode pixels to PNG of color type of colors in ctx->png. Pixels are
+   * in ctx->packed unless color type is RGBA. return 1 if success, -1 if
+   * fail. */
+  int i;
+
+  png_structp png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, pngError, pngWarning);
+  if (!png_ptr)
+  {
+    return -1;
+  }
+
+  png_infop info_ptr = png_create_info_struct(png_ptr);
+  if (!info_ptr)
+  {
+     png_destroy_write_struct(&png_ptr, (png_infopp)NULL);
+     return -1;
+  }
+  if (setjmp (png_jmpbuf (png_ptr)))
+  { /* libpng jumps here on error instead of aborting. */
+    png_destroy_write_struct(&png_ptr, &info_ptr);
+    return -1;
+  }
+
+  /* PNG is encoded to memory of ctx, then written to file at once. */
+  ctx->pngLen = 0;
+  png_set_write_fn(png_ptr, ctx, writePngData, flushPngData);
+
+  /* Compression is left to libpng unless specified by options. */
+  if (options->zlibLevel != -1)
+    png_set_compression_level(png_ptr, options->zlibLevel);
+  if (options->zlibStrategy != -1)
+    png_set_compression_strategy(png_ptr, options->zlibStrategy);
+  if (options->pngFilters != -1)
+    png_set_filter(png_ptr, PNG_FILTER_TYPE_BASE, options->pngFilters);
+
+  png_set_IHDR(png_ptr, info_ptr, width, height, colors->bitDepth,
+                colors->colorType, PNG_INTERLACE_NONE,
+                PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE);
+  if (colors->colorType == PNG_COLOR_TYPE_PALETTE)
+  {
+    png_set_PLTE (png_ptr, info_ptr, colors->palette, colors->npalette);
+    if (colors->ntrans > 0)
+      png_set_tRNS (png_ptr, info_ptr, colors->trans, colors->ntrans, NULL);
+  }
+
+  //Write file info.
+  png_write_info(png_ptr, info_ptr);
+
+  for (i = 0; i < height ;i++)
+  {
+    if (colors->colorType == PNG_COLOR_TYPE_RGB_ALPHA)
+      ctx->rows[i] = (png_bytep) pix + stride*i;
+    else
+      ctx->rows[i] = ctx->packed + colors->rowBytes*i;
+  }
+
+  //Write the image data.
+  png_write_image(png_ptr, ctx->rows);
+
+  png_write_end(png_ptr, NULL);
+
+  png_destroy_write_struct(&png_ptr, &info_ptr);
+  return 1;
+}
+
+static int reducePngColors (convContext *ctx, const unsigned char *pix,
+                            XcursorDim width, XcursorDim height,
+                            size_t stride, int palette, pngColors *colors)
+{ /* choose the smallest color type which keeps all RGBA values of pixels,
+   * and pack pixels of it to ctx->packed unless it is RGBA.
+   * Palette is used for up to 256 values if palette is 1, and its entries
+   * which are not opaque come first so that tRNS is short.
+   * return 0 if fail. */
+  uint32_t keys[512];       /* RGBA values in open addressing table. */
+  short slots[512];         /* order in which each key is found. -1 if empty. */
+  unsigned char found[257][4];
+  unsigned char remap[256]; /* palette index of each value in order found. */
+  int ncolor = 0, gray = 1, opaque = 1;
+  int channels, i, h;
+  XcursorDim x, y;
+  uint32_t key, last = 0;
+
+  memset (slots, -1, sizeof (slots));
+  for (y = 0; y < height; ++y)
+  {
+    const unsigned char *p = pix + stride * y;
+    for (x = 0; x < width; ++x, p += 4)
+    {
+      if (p[3] != 255)
+        opaque = 0;
+      if (p[0] != p[1] || p[1] != p[2])
+        gray = 0;
+      if (ncolor > 256)
+        continue;
+      key = p[0] | p[1] << 8 | p[2] << 16 | (uint32_t) p[3] << 24;
+      if (ncolor > 0 && key == last)
+        continue;
+      last = key;
+      for (h = (key * 2654435761u) >> 23; slots[h] != -1 && keys[h] != key;
+           h = (h + 1) & 511)
+        {;}
+      if (slots[h] == -1)
+      {
+        keys[h] = key;
+        slots[h] = ncolor;
+        memcpy (found[ncolor++], p, 4);
+      }
+    }
+    if (ncolor > 256 && !gray && !opaque)
+      break;
+  }
+
+  colors->bitDepth = 8;
+  colors->npalette = colors->ntrans = 0;
+  if (palette && (ncolor <= 16 || (ncolor <= 256 && !(gray && opaque))))
+  { /* index of 1, 2, 4 or 8 bits is smaller than any other type. */
+    colors->colorType = PNG_COLOR_TYPE_PALETTE;
+    colors->bitDepth = ncolor <= 2 ? 1 : ncolor <= 4 ? 2 : ncolor <= 16 ? 4 : 8;
+    for (i = 0; i < ncolor; ++i)
+    {
+      if (found[i][3] != 255)
+        remap[i] = colors->ntrans++;
+    }
+    colors->npalette = colors->ntrans;
+    for (i = 0; i < ncolor; ++i)
+    {
+      if (found[i][3] == 255)
+        remap[i] = colors->npalette++;
+    }
+    for (i = 0; i < ncolor; ++i)
+    {
+      colors->palette[remap[i]].red = found[i][0];
+      colors->palette[remap[i]].green = found[i][1];
+      colors->palette[remap[i]].blue = found[i][2];
+      colors->trans[remap[i]] = found[i][3];
+    }
+    channels = 1;
+  }
+  else if (gray)
+  {
+    colors->colorType = opaque ? PNG_COLOR_TYPE_GRAY
+                               : PNG_COLOR_TYPE_GRAY_ALPHA;
+    channels = opaque ? 1 : 2;
+  }
+  else if (opaque)
+  {
+    colors->colorType = PNG_COLOR_TYPE_RGB;
+    channels = 3;
+  }
+  else
+  {
+    colors->colorType = PNG_COLOR_TYPE_RGB_ALPHA;
+    return 1;
+  }
+
+  colors->rowBytes = ((size_t) width * channels * colors->bitDepth + 7) / 8;
+  if (!growBuffer (ctx, &ctx->packed, &ctx->packedSize,
+                   colors->rowBytes * height))
+    return 0;
+  memset (ctx->packed, 0, colors->rowBytes * height);
+  for (y = 0; y < height; ++y)
+  {
+    const unsigned char *p = pix + stride * y;
+    unsigned char *q = ctx->packed + colors->rowBytes * y;
+    for (x = 0; x < width; ++x, p += 4)
+    {
+      switch (colors->colorType)
+      {
+        case PNG_COLOR_TYPE_PALETTE:
+          key = p[0] | p[1] << 8 | p[2] << 16 | (uint32_t) p[3] << 24;
+          for (h = (key * 2654435761u) >> 23; keys[h] != key;
+               h = (h + 1) & 511)
+            {;}
+          i = x * colors->bitDepth;
+          q[i / 8] |= remap[slots[h]] << (8 - colors->bitDepth - i % 8);
+          break;
+        case PNG_COLOR_TYPE_GRAY:
+          q[x] = p[0];
+          break;
+        case PNG_COLOR_TYPE_GRAY_ALPHA:
+          q[x * 2] = p[0];
+          q[x * 2 + 1] = p[3];
+          break;
+        default:
+          memcpy (q + x * 3, p, 3);
+          break;
+      }
+    }
+  }
+  return 1;
+}
+
+static int encodeQoi (convContext *ctx, const unsigned char *pix,
+                      XcursorDim width, XcursorDim height, size_t stride)
+{ /* encode width x height RGBA pixels to QOI in ctx->png.
+   * return 1 if success, -1 if fail. */
+  unsigned char index[64][4];
+  unsigned char prev[4] = {0, 0, 0, 255};
+  unsigned char *out;
+  size_t n = 0;
+  XcursorDim x, y;
+  int run = 0;
+
+  /* worst case is 5 bytes per pixel, 14 bytes header and 8 bytes end. */
+  if (!growBuffer (ctx, &ctx->png, &ctx->pngSize,
+                   (size_t) width * height * 5 + 22))
+    return -1;
+  out = ctx->png;
+  memset (index, 0, sizeof (index));
+  memcpy (out, "qoif", 4);
+  out[4] = width >> 24; out[5] = width >> 16; out[6] = width >> 8;
+  out[7] = width;
+  out[8] = height >> 24; out[9] = height >> 16; out[10] = height >> 8;
+  out[11] = height;
+  out[12] = 4;    /* RGBA */
+  out[13] = 0;    /* sRGB with linear alpha */
+  n = 14;
+  for (y = 0; y < height; ++y)
+  {
+    const unsigned char *px = pix + stride * y;
+    for (x = 0; x < width; ++x, px += 4)
+    {
+      int h;
+      if (memcmp (px, prev, 4) == 0)
+      { /* QOI_OP_RUN holds 1 to 62 pixels. */
+        if (++run == 62 || (y == height - 1 && x == width - 1))
+        {
+          out[n++] = 0xc0 | (run - 1);
+          run = 0;
+        }
+        continue;
+      }
+      if (run > 0)
+      {
+        out[n++] = 0xc0 | (run - 1);
+        run = 0;
+      }
+      h = (px[0] * 3 + px[1] * 5 + px[2] * 7 + px[3] * 11) % 64;
+      if (memcmp (index[h], px, 4) == 0)
+      { /* QOI_OP_INDEX */
+        out[n++] = h;
+      }
+      else if (px[3] == prev[3])
+      {
+        signed char vr = px[0] - prev[0];
+        signed char vg = px[1] - prev[1];
+        signed char vb = px[2] - prev[2];
+        signed char vgr = vr - vg;
+        signed char vgb = vb - vg;
+        memcpy (index[h], px, 4);
+        if (vr > -3 && vr < 2 && vg > -3 && vg < 2 && vb > -3 && vb < 2)
+        { /* QOI_OP_DIFF */
+          out[n++] = 0x40 | (vr + 2) << 4 | (vg + 2) << 2 | (vb + 2);
+        }
+        else if (vgr > -9 && vgr < 8 && vg > -33 && vg < 32 &&
+                 vgb > -9 && vgb < 8)
+        { /* QOI_OP_LUMA */
+          out[n++] = 0x80 | (vg + 32);
+          out[n++] = (vgr + 8) << 4 | (vgb + 8);
+        }
+        else
+        { /* QOI_OP_RGB */
+          out[n++] = 0xfe;
+          out[n++] = px[0];
+          out[n++] = px[1];
+          out[n++] = px[2];
+        }
+      }
+      else
+      { /* QOI_OP_RGBA */
+        memcpy (index[h], px, 4);
+        out[n++] = 0xff;
+        memcpy (out + n, px, 4);
+        n += 4;
+      }
+      memcpy (prev, px, 4);
+    }
+  }
+  memcpy (out + n, "\0\0\0\0\0\0\0\1", 8);
+  ctx->pngLen = n + 8;
+  return 1;
+}
+
+static int encodeRaw (convContext *ctx, const unsigned char *pix,
+                      XcursorDim width, XcursorDim height, size_t stride,
+                      int pam)
+{ /* copy width x height RGBA pixels to ctx->png as they are, after PAM
+   * header if pam. return 1 if success, -1 if fail. */
+  char header[128];
+  int headerLen = 0;
+  size_t row = (size_t) width * 4;
+  XcursorDim y;
+
+  if (pam)
+    headerLen = snprintf (header, sizeof (header),
+                          "P7\nWIDTH %u\nHEIGHT %u\nDEPTH 4\nMAXVAL 255\n"
+                          "TUPLTYPE RGB_ALPHA\nENDHDR\n",
+                          (unsigned int) width, (unsigned int) height);
+  if (!growBuffer (ctx, &ctx->png, &ctx->pngSize,
+                   headerLen + row * height))
+    return -1;
+  memcpy (ctx->png, header, headerLen);
+  ctx->pngLen = headerLen;
+  for (y = 0; y < height; ++y)
+  {
+    memcpy (ctx->png + ctx->pngLen, pix + stride * y, row);
+    ctx->pngLen += row;
+  }
+  return 1;
+}
+
+int encodeImage (convContext *ctx, const unsigned char *pix,
+                 const XcursorDim width, const XcursorDim height, size_t stride,
+                 const xcur2pngOptions *options)
+{ /* encode width x height RGBA pixels to options->format in ctx->png.
+   * return 1 if success, -1 if fail. */
+  switch (options->format)
+  {
+    case XCUR2PNG_FORMAT_QOI:
+      return encodeQoi (ctx, pix, width, height, stride);
+    case XCUR2PNG_FORMAT_PAM:
+      return encodeRaw (ctx, pix, width, height, stride, 1);
+    case XCUR2PNG_FORMAT_RGBA:
+      return encodeRaw (ctx, pix, width, height, stride, 0);
+    default:
+      return encodePng (ctx, pix, width, height, stride, options);
+  }
+}
+
+int encodeXcursorImage (convContext *ctx, const xcurImage *image,
+                        const xcur2pngOptions *options)
+{ /* un-premultiply image and encode it to options->format in ctx->png.
+   * return XCUR2PNG_OK if success. */
+  if (!reserveConvContext (ctx, image->width, image->height))
+    return XCUR2PNG_ENOMEM;
+  unpremultiplyPixels (ctx->pix, image->pixels,
+                       (size_t) image->width * image->height);
+  if (encodeImage (ctx, ctx->pix, image->width, image->height,
+                   (size_t) image->width * 4, options) == -1)
+    return XCUR2PNG_EPNG;
+  return XCUR2PNG_OK;
+}
+
+static void initUnpremultiplyTable (void)
+{ /* called once by initConvContext. */
+  unsigned int alpha, value;
+  for (value = 0; value < 256; ++value)
+  { /* pixels which alpha is 0 are left as they are. */
+    unpremultiplyTable[0][value] = value;
+  }
+  for (alpha = 1; alpha < 256; ++alpha)
+  {
+    for (value = 0; value < 256; ++value)
+    { /* value * 256 / alpha is 256 when value equals alpha (and more when
+       * Xcursor is broken), which must not wrap to 0. */
+      unsigned int v = value * 256 / alpha;
+      unpremultiplyTable[alpha][value] = (v > 255) ? 255 : v;
+    }
+  }
+  return;
+}
+
+void unpremultiplyPixels (unsigned char *dst, const unsigned char *src, int n)
+{ /* Get back non-premultiplied RGBA of n pixels from src to dst.
+   * src is premultiplied ARGB in little endian (i.e. BGRA bytes).
+   * Table lookup gives same result as min (value * 256 / alpha, 255). */
+  int i;
+  for (i = 0; i < n; i++, src += 4, dst += 4)
+  {
+    const unsigned char *t = unpremultiplyTable[src[3]];
+    dst[0] = t[src[2]];
+    dst[1] = t[src[1]];
+    dst[2] = t[src[0]];
+    dst[3] = src[3];
+  }
+  return;
+}
+
+static XcursorUInt readUInt (const unsigned char *p)
+{ /* Xcursor is always little endian. */
+  return (XcursorUInt) p[0] | ((XcursorUInt) p[1] << 8)
+         | ((XcursorUInt) p[2] << 16) | ((XcursorUInt) p[3] << 24);
+}
+
+static int imageIsSelected (XcursorDim size, int frame,
+                            const xcur2pngOptions *options)
+{ /* return 1 if frame-th image of nominal size is selected by options. */
+  int i;
+  if (frame < options->firstFrame ||
+      (options->lastFrame != -1 && frame > options->lastFrame))
+    return 0;
+  for (i = 0; i < options->nsizes; ++i)
+  {
+    if (options->sizes[i] == size)
+      return 1;
+  }
+  return options->nsizes == 0;
+}
+
+int parseXcursor (xcurFile *xf, const unsigned char *data, size_t length,
+                  const xcur2pngOptions *options)
+{ /* Read header and table of contents of Xcursor in data, and check
+   * every selected image chunk fits in data. Images which are not
+   * selected by sizes and frames of options are skipped by table of contents,
+   * so their chunks are never read. Pixels are not read here, and pages of
+   * chunk headers are released as soon as they are checked, so that
+   * memory usage does not grow with the number of images.
+   * xf->mapped must be set by caller.
+   * return 1 if success, 0 if data is not valid Xcursor. */
+  XcursorUInt header, ntoc, i;
+  size_t position;
+  int n = 0;
+  XcursorDim *sizes;  /* nominal sizes seen in table of contents. */
+  int *frames;        /* number of images of each size seen. */
+  int nsize = 0;
+  int frame;
+
+  xf->data = data;
+  xf->length = length;
+  xf->nimage = 0;
+  xf->positions = NULL;
+  /* File header is "Xcur", header length, version and ntoc. */
+  if (length < 16 || readUInt (data) != XCURSOR_MAGIC)
+    return 0;
+  header = readUInt (data + 4);
+  ntoc = readUInt (data + 12);
+  if (header < 16 || header > length || ntoc > (length - header) / 12)
+    return 0;
+  xf->positions = malloc ((ntoc ? ntoc : 1) * sizeof (size_t));
+  sizes = malloc ((ntoc ? ntoc : 1) * sizeof (XcursorDim));
+  frames = malloc ((ntoc ? ntoc : 1) * sizeof (int));
+  if (!xf->positions || !sizes || !frames)
+  {
+    free (xf->positions);
+    free (sizes);
+    free (frames);
+    xf->positions = NULL;
+    return 0;
+  }
+  /* Each entry of table of contents is type, subtype and position. */
+  for (i = 0; i < ntoc; ++i)
+  {
+    const unsigned char *toc = data + header + i * 12;
+    XcursorUInt width, height;
+    int s;
+    if (readUInt (toc) != XCURSOR_IMAGE_TYPE)
+      continue;
+    /* subtype of image is nominal size. count frames of each size. */
+    for (s = 0; s < nsize && sizes[s] != readUInt (toc + 4); ++s)
+      {;}
+    if (s == nsize)
+    {
+      sizes[nsize] = readUInt (toc + 4);
+      frames[nsize++] = 0;
+    }
+    frame = frames[s]++;
+    if (!imageIsSelected (sizes[s], frame, options))
+      continue;
+    position = readUInt (toc + 8);
+    /* Image chunk is header, type, subtype, version, width, height,
+     * xhot, yhot, delay and pixels. */
+    if (position > length || length - position < 36 ||
+        readUInt (data + position + 4) != XCURSOR_IMAGE_TYPE ||
+        readUInt (data + position + 8) != readUInt (toc + 4))
+      break;
+    width = readUInt (data + position + 16);
+    height = readUInt (data + position + 20);
+    if (width == 0 || height == 0 || width > XCURSOR_IMAGE_MAX_SIZE ||
+        height > XCURSOR_IMAGE_MAX_SIZE ||
+        readUInt (data + position + 24) > width ||
+        readUInt (data + position + 28) > height ||
+        (length - position - 36) / 4 / width < height)
+      break;
+    xf->positions[n++] = position;
+    releaseData (xf, data + position, 36);
+  }
+  free (sizes);
+  free (frames);
+  if (i < ntoc)
+  {
+    free (xf->positions);
+    xf->positions = NULL;
+    return 0;
+  }
+  xf->nimage = n;
+  return 1;
+}
+
+static int reportProblem (void (*problem) (void *closure, const char *message),
+                          void *closure, const char *format, ...)
+{ /* format message and pass it to problem. return 1. */
+  char message[128];
+  va_list ap;
+  va_start (ap, format);
+  vsnprintf (message, sizeof (message), format, ap);
+  va_end (ap);
+  if (problem)
+    problem (closure, message);
+  return 1;
+}
+
+int xcur2pngCheck (const unsigned char *data, size_t length, int *nimagep,
+                   void (*problem) (void *closure, const char *message),
+                   void *closure)
+{ /* check header, table of contents and image chunk headers of Xcursor
+   * in data against length of data, and pass each problem found to
+   * problem. Pixels are never read, so only pages of headers are touched.
+   * Image chunks are checked as xcursorgen and libXcursor need them.
+   * set number of image chunks to *nimagep and return number of problems. */
+  XcursorUInt header, ntoc, i;
+  XcursorUInt type, subtype, width, height;
+  size_t position;
+  int nproblem = 0;
+
+  *nimagep = 0;
+  /* File header is "Xcur", header length, version and ntoc. */
+  if (length < 16)
+    return reportProblem (problem, closure,
+                          "file of %lu bytes is shorter than header",
+                          (unsigned long) length);
+  if (readUInt (data) != XCURSOR_MAGIC)
+    return reportProblem (problem, closure, "not an Xcursor");
+  header = readUInt (data + 4);
+  ntoc = readUInt (data + 12);
+  if (header < 16 || header > length)
+    return reportProblem (problem, closure,
+                          "header length %u is out of file", header);
+  if (ntoc > (length - header) / 12)
+    return reportProblem (problem, closure,
+                          "table of contents of %u entries is truncated", ntoc);
+  /* Each entry of table of contents is type, subtype and position. */
+  for (i = 0; i < ntoc; ++i)
+  {
+    const unsigned char *toc = data + header + i * 12;
+    const unsigned char *chunk;
+    type = readUInt (toc);
+    subtype = readUInt (toc + 4);
+    position = readUInt (toc + 8);
+    if (type != XCURSOR_IMAGE_TYPE)
+    { /* comments and unknown chunks are only located. */
+      if (position > length || length - position < 16)
+        nproblem += reportProblem (problem, closure,
+                                   "entry %u: chunk at %lu is out of file",
+                                   i, (unsigned long) position);
+      continue;
+    }
+    ++*nimagep;
+    /* Image chunk is header, type, subtype, version, width, height,
+     * xhot, yhot, delay and pixels. */
+    if (position > length || length - position < 36)
+    {
+      nproblem += reportProblem (problem, closure,
+                                 "image %u: chunk header at %lu is truncated",
+                                 i, (unsigned long) position);
+      continue;
+    }
+    chunk = data + position;
+    if (readUInt (chunk) != 36)
+      nproblem += reportProblem (problem, closure,
+                                 "image %u: chunk header length is %u, not 36",
+                                 i, readUInt (chunk));
+    if (readUInt (chunk + 4) != type || readUInt (chunk + 8) != subtype)
+      nproblem += reportProblem (problem, closure,
+                                 "image %u: chunk type or size %u does not "
+                                 "match table of contents", i,
+                                 readUInt (chunk + 8));
+    if (readUInt (chunk + 12) != XCURSOR_IMAGE_VERSION)
+      nproblem += reportProblem (problem, closure,
+                                 "image %u: version %u is not supported",
+                                 i, readUInt (chunk + 12));
+    width = readUInt (chunk + 16);
+    height = readUInt (chunk + 20);
+    if (width == 0 || height == 0 || width > XCURSOR_IMAGE_MAX_SIZE ||
+        height > XCURSOR_IMAGE_MAX_SIZE)
+    {
+      nproblem += reportProblem (problem, closure,
+                                 "image %u: %ux%u is out of range",
+                                 i, width, height);
+      continue;
+    }
+    if (readUInt (chunk + 24) > width || readUInt (chunk + 28) > height)
+      nproblem += reportProblem (problem, closure,
+                                 "image %u: hotspot %u,%u is out of %ux%u",
+                                 i, readUInt (chunk + 24),
+                                 readUInt (chunk + 28), width, height);
+    if ((length - position - 36) / 4 / width < height)
+      nproblem += reportProblem (problem, closure,
+                                 "image %u: pixels are truncated "
+                                 "(%lu of %lu bytes)", i,
+                                 (unsigned long) (length - position - 36),
+                                 (unsigned long) width * height * 4);
+  }
+  if (*nimagep == 0)
+    nproblem += reportProblem (problem, closure, "no image");
+  return nproblem;
+}
+
+void freeXcursor (xcurFile *xf)
+{ /* free memory allocated by parseXcursor. data is not freed. */
+  free (xf->positions);
+  xf->positions = NULL;
+  xf->nimage = 0;
+  return;
+}
+
+void getXcursorImage (const xcurFile *xf, int index, xcurImage *image)
+{ /* set properties of index-th image. parseXcursor checked them already. */
+  const unsigned char *chunk = xf->data + xf->positions[index];
+  image->size = readUInt (chunk + 8);
+  image->version = readUInt (chunk + 12);
+  image->width = readUInt (chunk + 16);
+  image->height = readUInt (chunk + 20);
+  image->xhot = readUInt (chunk + 24);
+  image->yhot = readUInt (chunk + 28);
+  image->delay = readUInt (chunk + 32);
+  image->pixels = chunk + 36;
+  return;
+}
+
+void releaseXcursorImage (const xcurFile *xf, const xcurImage *image)
+{ /* Tell kernel that chunk of image is no longer needed, so memory
+   * usage does not grow with file size. Pages are read again from file
+   * if they are touched later. Nothing is done unless data is mmapped
+   * from file, because other memory would be lost. Pages shared with
+   * neighbour images are released too, otherwise small images would
+   * never release any page. */
+  releaseData (xf, image->pixels - 36,
+               36 + (size_t) image->width * image->height * 4);
+  return;
+}
+
+static void releaseData (const xcurFile *xf, const unsigned char *p,
+                         size_t length)
+{ /* release pages which have length bytes from p. */
+  long page = sysconf (_SC_PAGESIZE);
+  uintptr_t start = (uintptr_t) p;
+  uintptr_t end = start + length;
+  if (!xf->mapped || page <= 0)
+    return;
+  start &= ~(uintptr_t) (page - 1);
+  end = (end + page - 1) & ~(uintptr_t) (page - 1);
+  if (start < end)
+    madvise ((void *) start, end - start, MADV_DONTNEED);
+  return;
+}
+
+uint64_t hashImage (const xcurImage *image)
+{ /* FNV-1a hash of size and pixels of image. */
+  uint64_t hash = 14695981039346656037ULL;
+  size_t i;
+  size_t len = (size_t) image->width * image->height * 4;
+  hash = (hash ^ image->width) * 1099511628211ULL;
+  hash = (hash ^ image->height) * 1099511628211ULL;
+  for (i = 0; i < len; ++i)
+  {
+    hash = (hash ^ image->pixels[i]) * 1099511628211ULL;
+  }
+  return hash;
+}
+
+/* SHA-256 of FIPS 180-4. Only digestImage uses it, so that names of
+ * objects of store do not collide by chance as 64 bits hash may. */
+typedef struct {
+  uint32_t state[8];
+  unsigned char block[64];
+  size_t used;          /* bytes in block. */
+  uint64_t length;      /* total bytes. */
+} sha256Context ;
+
+static const uint32_t sha256K[64] = {
+  0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+  0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+  0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+  0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+  0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+  0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+  0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+  0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+  0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+  0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+  0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void sha256Block (uint32_t *state, const unsigned char *p)
+{ /* process a block of 64 bytes. */
+  uint32_t w[64];
+  uint32_t a, b, c, d, e, f, g, h, t1, t2;
+  int i;
+  for (i = 0; i < 16; ++i, p += 4)
+    w[i] = ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16)
+           | ((uint32_t) p[2] << 8) | p[3];
+  for (; i < 64; ++i)
+    w[i] = (ROTR (w[i - 2], 17) ^ ROTR (w[i - 2], 19) ^ (w[i - 2] >> 10))
+           + w[i - 7]
+           + (ROTR (w[i - 15], 7) ^ ROTR (w[i - 15], 18) ^ (w[i - 15] >> 3))
+           + w[i - 16];
+  a = state[0]; b = state[1]; c = state[2]; d = state[3];
+  e = state[4]; f = state[5]; g = state[6]; h = state[7];
+  for (i = 0; i < 64; ++i)
+  {
+    t1 = h + (ROTR (e, 6) ^ ROTR (e, 11) ^ ROTR (e, 25))
+         + ((e & f) ^ (~e & g)) + sha256K[i] + w[i];
+    t2 = (ROTR (a, 2) ^ ROTR (a, 13) ^ ROTR (a, 22))
+         + ((a & b) ^ (a & c) ^ (b & c));
+    h = g; g = f; f = e; e = d + t1;
+    d = c; c = b; b = a; a = t1 + t2;
+  }
+  state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+  state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+  return;
+}
+
+#undef ROTR
+
+static void sha256Init (sha256Context *sc)
+{
+  static const uint32_t initial[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+    0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+  };
+  memcpy (sc->state, initial, sizeof (initial));
+  sc->used = 0;
+  sc->length = 0;
+  return;
+}
+
+static void sha256Update (sha256Context *sc, const unsigned char *data,
+                          size_t length)
+{ /* whole blocks of data are processed where they are. */
+  size_t n;
+  sc->length += length;
+  if (sc->used)
+  {
+    n = 64 - sc->used < length ? 64 - sc->used : length;
+    memcpy (sc->block + sc->used, data, n);
+    sc->used += n;
+    data += n;
+    length -= n;
+    if (sc->used < 64)
+      return;
+    sha256Block (sc->state, sc->block);
+    sc->used = 0;
+  }
+  for (; length >= 64; data += 64, length -= 64)
+    sha256Block (sc->state, data);
+  memcpy (sc->block, data, length);
+  sc->used = length;
+  return;
+}
+
+static void sha256Final (sha256Context *sc, unsigned char *digest)
+{ /* pad with 0x80, zeros and length in bits, and write 32 bytes. */
+  uint64_t bits = sc->length * 8;
+  int i;
+  sc->block[sc->used++] = 0x80;
+  if (sc->used > 56)
+  {
+    memset (sc->block + sc->used, 0, 64 - sc->used);
+    sha256Block (sc->state, sc->block);
+    sc->used = 0;
+  }
+  memset (sc->block + sc->used, 0, 56 - sc->used);
+  for (i = 0; i < 8; ++i)
+    sc->block[56 + i] = bits >> (56 - i * 8);
+  sha256Block (sc->state, sc->block);
+  for (i = 0; i < 32; ++i)
+    digest[i] = sc->state[i / 4] >> (24 - (i % 4) * 8);
+  return;
+}
+
+void digestImage (const xcurImage *image, unsigned char *digest)
+{ /* SHA-256 of width and height (32 bits little endian each) and pixels of
+   * image to IMAGE_DIGEST_LENGTH bytes of digest. */
+  sha256Context sc;
+  unsigned char header[8];
+  int i;
+  for (i = 0; i < 4; ++i)
+  {
+    header[i] = image->width >> (i * 8);
+    header[4 + i] = image->height >> (i * 8);
+  }
+  sha256Init (&sc);
+  sha256Update (&sc, header, 8);
+  sha256Update (&sc, image->pixels, (size_t) image->width * image->height * 4);
+  sha256Final (&sc, digest);
+  return;
+}
+
+int sameImage (const xcurImage *a, const xcurImage *b)
+{ /* return 1 if a and b have same pixels. hotspot and delay are ignored. */
+  return a->width == b->width && a->height == b->height &&
+         memcmp (a->pixels, b->pixels, (size_t) a->width * a->height * 4) == 0;
+}
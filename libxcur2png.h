@@ -0,0 +1,103 @@
+/* Copyright (C) 2008-2009 tks
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/* libxcur2png converts Xcursor in memory to PNG images in memory (or QOI,
+ * PAM or raw RGBA images if options->format says so).
+ * It never touches filesystem, never prints, never exits and has no global
+ * state except constant tables, so it can be used from many threads at once.
+ * Functions and structures which xcur2png command uses to convert images
+ * one by one are declared in libxcur2png-private.h, which is not installed. */
+
+#ifndef LIBXCUR2PNG_H
+#define LIBXCUR2PNG_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <X11/Xcursor/Xcursor.h>
+
+/* return values of xcur2pngConvert and planXcursor. */
+enum XCUR2PNG_ERROR {
+  XCUR2PNG_OK = 0,
+  XCUR2PNG_EINVALID,    /* data is not valid Xcursor. */
+  XCUR2PNG_EVERSION,    /* version of image is not 1. */
+  XCUR2PNG_ENOMEM,      /* memory cannot be allocated. */
+  XCUR2PNG_EPNG,        /* libpng failed to encode PNG. */
+  XCUR2PNG_ECALLBACK    /* callback returned non-zero. */
+};
+
+/* image formats which images are encoded to. */
+enum XCUR2PNG_FORMAT {
+  XCUR2PNG_FORMAT_PNG = 0,
+  XCUR2PNG_FORMAT_QOI,      /* Quite OK Image format, RGBA. */
+  XCUR2PNG_FORMAT_PAM,      /* netpbm PAM, RGB_ALPHA, uncompressed. */
+  XCUR2PNG_FORMAT_RGBA      /* raw RGBA bytes without header. */
+};
+
+typedef struct {
+  int zlibLevel;            /* zlib level. -1 means libpng default. */
+  int zlibStrategy;         /* zlib strategy. -1 means libpng default. */
+  int pngFilters;           /* PNG filters. -1 means libpng default. */
+  const XcursorDim *sizes;  /* nominal sizes to be converted. */
+  int nsizes;               /* number of sizes. 0 means all sizes. */
+  int firstFrame;           /* frames of each nominal size to be converted. */
+  int lastFrame;            /* -1 means the last frame. */
+  int dedupe;               /* 1: identical images share one PNG. */
+  int format;               /* XCUR2PNG_FORMAT_*. zlib and filters are
+                               used only for PNG. */
+  int keepRgba;             /* 1: PNG is always RGBA. 0: the smallest
+                               lossless color type is chosen for each PNG. */
+} xcur2pngOptions ;
+
+typedef struct {
+  XcursorUInt version;
+  XcursorDim size;    /* nominal size. */
+  XcursorDim width;
+  XcursorDim height;
+  XcursorDim xhot;
+  XcursorDim yhot;
+  XcursorUInt delay;
+  const unsigned char *pixels;  /* premultiplied ARGB in little endian.
+                                   This points into xcurFile.data. */
+} xcurImage ;
+
+typedef struct {
+  XcursorDim size;
+  XcursorDim xhot;
+  XcursorDim yhot;
+  XcursorUInt delay;
+  int png;              /* number of PNG which has the image, from 0. */
+} xcur2pngEntry ;       /* a line of config-file. */
+
+typedef struct {
+  /* called for each entry of config-file in order. may be NULL. */
+  int (*entry) (void *closure, const xcur2pngEntry *entry);
+  /* called for each PNG in order of its number. data is valid only
+   * until callback returns. may be NULL. */
+  int (*png) (void *closure, int png, const xcurImage *image,
+              const unsigned char *data, size_t length);
+} xcur2pngCallbacks ;
+
+/* High level API. */
+void xcur2pngInitOptions (xcur2pngOptions *options);
+int xcur2pngConvert (const unsigned char *data, size_t length,
+                     const xcur2pngOptions *options,
+                     const xcur2pngCallbacks *callbacks, void *closure);
+const char *xcur2pngStrerror (int error);
+const char *xcur2pngExtension (int format);
+int xcur2pngCheck (const unsigned char *data, size_t length, int *nimagep,
+                   void (*problem) (void *closure, const char *message),
+                   void *closure);
+
+#endif /* LIBXCUR2PNG_H */
@@ -0,0 +1,68 @@
+/* Copyright (C) 2008-2009 tks
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/* Check digestImage, which names objects of --store, against SHA-256 of
+ * another implementation. Heights are chosen so that padding ends just
+ * before, at and after the end of a block of 64 bytes. */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libxcur2png-private.h"
+
+static const struct {
+  XcursorDim height;    /* width is 1. */
+  const char *digest;
+} vectors[] = {
+  {0, "7c9fa136d4413fa6173637e883b6998d32e1d675f88cddff9dcbcf331820f4b8"},
+  {11, "21a8a1b843e01a9aa81d39fe1260ca1bc2a3e9bb8720cc060c75a3389dc9e6e8"},
+  {12, "aa55f111736fcf8a14a47ff585ffa3e903db8b7bd20ddb3290c608becc1b3bfd"},
+  {13, "aba049dab3381026e17ecdb1aa3b67d1abedeb9bbaaaee1f70e9901aa868b623"},
+  {14, "03ac66377d6cc51743584fb798a5a6a574882ff5a5f93f8832b79bb942d009ad"},
+  {30, "a56714f9b86210e4427ad8996787111d320c6d7f09a5da897f83e4cc906cc2da"},
+  {100, "944232baca524fd0daa9d1640ad94710f3951fe608206ab3c132935e70cdf0db"},
+};
+
+int main (void)
+{
+  static unsigned char pixels[100 * 4];
+  unsigned char digest[IMAGE_DIGEST_LENGTH];
+  char hex[IMAGE_DIGEST_LENGTH * 2 + 1];
+  xcurImage image;
+  int bad = 0;
+  size_t i;
+  int j;
+
+  for (i = 0; i < sizeof (pixels); ++i)
+    pixels[i] = i * 7 + 3;
+  memset (&image, 0, sizeof (image));
+  image.width = 1;
+  image.pixels = pixels;
+  for (i = 0; i < sizeof (vectors) / sizeof (vectors[0]); ++i)
+  {
+    image.height = vectors[i].height;
+    digestImage (&image, digest);
+    for (j = 0; j < IMAGE_DIGEST_LENGTH; ++j)
+      sprintf (hex + j * 2, "%02x", digest[j]);
+    if (strcmp (hex, vectors[i].digest) != 0)
+    {
+      fprintf (stderr, "height %u: got %s\n", vectors[i].height, hex);
+      ++bad;
+    }
+  }
+  return bad ? 1 : 0;
+}
@@ -0,0 +1,54 @@
+#!/bin/sh
+# Convert a synthetic Xcursor of more than 10000 frames, far beyond the old
+# limit of 999 suffixes, through the parallel job queue and writer threads,
+# and check every image is named, listed and written once.
+
+frames=10500
+dir=manyframes.dir
+xcur2png=${top_builddir-..}/xcur2png
+mkxcursor=${top_builddir-..}/bench/mkxcursor
+
+fail ()
+{
+  echo "FAIL: $*" >&2
+  exit 1
+}
+
+rm -rf $dir
+mkdir $dir $dir/out $dir/wide $dir/dedupe $dir/tail || exit 99
+$mkxcursor -s 8 -n $frames -a binary -d 10 $dir/many.xcur || exit 99
+
+$xcur2png -q --check $dir/many.xcur 2>/dev/null || fail "--check"
+
+$xcur2png -q -j 4 --write-threads 2 -c $dir/out -d $dir/out $dir/many.xcur \
+  2>/dev/null || fail "conversion"
+n=`ls $dir/out | grep -c '^many\.xcur_[0-9]*\.png$'`
+test "$n" = $frames || fail "$n PNGs instead of $frames"
+n=`grep -c -v '^#' $dir/out/many.xcur.conf`
+test "$n" = $frames || fail "$n config-file lines instead of $frames"
+# suffix keeps its minimum width of 3 and grows after 999.
+sed -n '2p;1001p;1002p;$p' $dir/out/many.xcur.conf | cut -f 4 > $dir/names
+printf 'many.xcur_000.png\nmany.xcur_999.png\nmany.xcur_1000.png\nmany.xcur_10499.png\n' \
+  | cmp -s - $dir/names || fail "names: `cat $dir/names`"
+
+$xcur2png -q -j 4 --suffix-width 6 -i 5 -c $dir/wide -d $dir/wide \
+  $dir/many.xcur 2>/dev/null || fail "conversion with --suffix-width"
+test -f $dir/wide/many.xcur_000005.png -a -f $dir/wide/many.xcur_010504.png \
+  || fail "--suffix-width 6 -i 5"
+
+# all frames are different, so --dedupe keeps all of them.
+$xcur2png -q --dedupe -c $dir/dedupe -d $dir/dedupe $dir/many.xcur \
+  2>/dev/null || fail "conversion with --dedupe"
+n=`ls $dir/dedupe | grep -c '\.png$'`
+test "$n" = $frames || fail "--dedupe wrote $n PNGs instead of $frames"
+
+# frames near the end are found through the frame index.
+$xcur2png -q --frames 10490- -c $dir/tail -d $dir/tail $dir/many.xcur \
+  2>/dev/null || fail "conversion with --frames"
+n=`grep -c -v '^#' $dir/tail/many.xcur.conf`
+test "$n" = 10 || fail "$n frames selected instead of 10"
+cmp -s $dir/tail/many.xcur_000.png $dir/out/many.xcur_10490.png \
+  || fail "--frames 10490- does not start at frame 10490"
+
+rm -rf $dir
+exit 0
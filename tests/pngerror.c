@@ -0,0 +1,76 @@
+/* Copyright (C) 2008-2009 tks
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/* Check that a PNG which libpng refuses to encode makes encodeImage fail
+ * without printing anything to stderr of the program. */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "libxcur2png-private.h"
+
+int main (void)
+{
+  static unsigned char pix[4 * 4 * 4];
+  xcur2pngOptions options;
+  convContext ctx;
+  FILE *err = tmpfile ();
+  int saved, ret, again;
+  off_t printed;
+
+  if (!err)
+  {
+    perror ("tmpfile");
+    return 99;
+  }
+  xcur2pngInitOptions (&options);
+  options.keepRgba = 1;
+  initConvContext (&ctx);
+  if (!reserveConvContext (&ctx, 4, 4))
+  {
+    fprintf (stderr, "Cannot allocate buffers!\n");
+    return 99;
+  }
+  fflush (stderr);
+  saved = dup (2);
+  dup2 (fileno (err), 2);
+  /* IHDR of width 0 is an error of libpng. */
+  ret = encodeImage (&ctx, pix, 0, 4, 0, &options);
+  fflush (stderr);
+  dup2 (saved, 2);
+  close (saved);
+  printed = lseek (fileno (err), 0, SEEK_END);
+  /* the context is still usable after the error. */
+  again = encodeImage (&ctx, pix, 4, 4, 16, &options);
+  freeConvContext (&ctx);
+  if (ret != -1)
+  {
+    fprintf (stderr, "encodeImage returned %d instead of -1.\n", ret);
+    return 1;
+  }
+  if (printed != 0)
+  {
+    fprintf (stderr, "%ld bytes were printed to stderr.\n", (long) printed);
+    return 1;
+  }
+  if (again != 1)
+  {
+    fprintf (stderr, "encodeImage failed after an error.\n");
+    return 1;
+  }
+  return 0;
+}
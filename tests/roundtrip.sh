@@ -0,0 +1,101 @@
+#!/bin/sh
+# Convert synthetic Xcursors of each kind of alpha to config-file and PNGs,
+# rebuild them by --reverse as xcursorgen does, and compare error of color
+# channels with roundtrip.baseline. Fail if error is larger than the
+# baseline.
+# "roundtrip.sh --speed" also measures speed of conversion, and fails if it
+# is less than half of the baseline. Speed depends on the machine and its
+# load, so "make check" does not check it; "make bench" does.
+# "roundtrip.sh --update" writes measured values to the baseline instead,
+# e.g. after an intended change or on a much slower machine.
+
+mode=$1
+alphas="opaque binary smooth random"
+sizes=24,32,48,64,128
+frames=16
+runs=1
+dir=roundtrip.dir
+xcur2png=${top_builddir-..}/xcur2png
+mkxcursor=${top_builddir-..}/bench/mkxcursor
+xcurcmp=./xcurcmp
+baseline=${srcdir-.}/roundtrip.baseline
+
+fail ()
+{
+  echo "FAIL: $*" >&2
+  exit 1
+}
+
+case "$mode" in
+  "") ;;
+  --speed|--update) runs=3 ;;
+  *) echo "Usage: $0 [--speed|--update]" >&2; exit 99 ;;
+esac
+
+rm -rf $dir
+mkdir $dir $dir/out $dir/rebuilt || exit 99
+for alpha in $alphas
+do
+  $mkxcursor -s $sizes -n $frames -a $alpha $dir/$alpha || exit 99
+done
+
+# seconds of conversion are the sum of "total" of --stats, best of runs.
+best=
+run=0
+while test $run -lt $runs
+do
+  $xcur2png -q -j 1 --stats=$dir/stats -c $dir/out -d $dir/out \
+    `for alpha in $alphas; do echo $dir/$alpha; done` 2>/dev/null \
+    || fail "conversion"
+  seconds=`sed 's/.*"total": \([0-9.]*\).*/\1/' $dir/stats \
+    | awk '{ s += $1 } END { printf "%f", s }'`
+  best=`echo "$best $seconds" | awk '{ print ($2 == "" || $1 < $2) ? $1 : $2 }'`
+  run=`expr $run + 1`
+done
+
+$xcur2png -q --reverse -d $dir/rebuilt \
+  `for alpha in $alphas; do echo $dir/out/$alpha.conf; done` 2>/dev/null \
+  || fail "--reverse"
+
+: > $dir/measured
+total=0
+for alpha in $alphas
+do
+  result=`$xcurcmp $dir/$alpha $dir/rebuilt/$alpha` || fail "$alpha: images differ"
+  set dummy $result
+  echo "$alpha $3 $4" >> $dir/measured
+  total=`expr $total + $2`
+done
+if test -n "$mode"
+then
+  speed=`echo "$total $best" | awk '{ printf "%.1f", $1 / ($2 > 0 ? $2 : 1e-6) / 1e6 }'`
+  echo "speed $speed" >> $dir/measured
+fi
+echo "# alpha, largest and mean error of a color channel;"
+echo "# speed of conversion in megapixels per second."
+cat $dir/measured
+
+if test "$mode" = --update
+then
+  { echo "# Round trip of roundtrip.sh through config-file, PNGs and --reverse."
+    echo "# alpha, largest and mean error of a color channel;"
+    echo "# speed of conversion in megapixels per second."
+    cat $dir/measured
+  } > $baseline || exit 99
+  rm -rf $dir
+  exit 0
+fi
+
+test -f $baseline || fail "no baseline \"$baseline\""
+awk 'NR == FNR { if ($1 !~ /^#/) base[$1] = $0; next }
+     !($1 in base) { print "no baseline of " $1; bad = 1; next }
+     { split (base[$1], b, " ") }
+     $1 == "speed" && $2 < b[2] / 2 {
+       print "speed " $2 " is less than half of baseline " b[2]; bad = 1 }
+     $1 != "speed" && ($2 > b[2] || $3 > b[3] + 0.000001) {
+       print $1 ": error " $2 " " $3 " is larger than baseline " b[2] " " b[3]
+       bad = 1 }
+     END { exit bad }' $baseline $dir/measured >&2 || fail "regression"
+
+rm -rf $dir
+exit 0
@@ -0,0 +1,72 @@
+/* Copyright (C) 2008-2009 tks
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/* Check unpremultiplyPixels against arithmetic for all 65536 pairs of
+ * value and alpha, in each of the three color channels. */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "libxcur2png-private.h"
+
+static unsigned int expected (unsigned int value, unsigned int alpha)
+{ /* the arithmetic which unpremultiplyTable replaces. */
+  if (alpha == 0)
+    return value;
+  value = div (value * 256, alpha).quot;
+  return (value > 255) ? 255 : value;
+}
+
+int main (void)
+{
+  static unsigned char src[256 * 256 * 4], dst[256 * 256 * 4];
+  convContext ctx;
+  unsigned int alpha, value, i;
+  int bad = 0;
+
+  initConvContext (&ctx);
+  for (alpha = 0; alpha < 256; ++alpha)
+  {
+    for (value = 0; value < 256; ++value)
+    { /* BGRA bytes. each channel has different value to catch swaps. */
+      unsigned char *p = src + (alpha * 256 + value) * 4;
+      p[0] = value;
+      p[1] = (value + 85) & 0xff;
+      p[2] = (value + 170) & 0xff;
+      p[3] = alpha;
+    }
+  }
+  unpremultiplyPixels (dst, src, 256 * 256);
+  for (i = 0; i < 256 * 256; ++i)
+  {
+    const unsigned char *s = src + i * 4, *d = dst + i * 4;
+    if (d[0] != expected (s[2], s[3]) || d[1] != expected (s[1], s[3]) ||
+        d[2] != expected (s[0], s[3]) || d[3] != s[3])
+    {
+      if (bad < 10)
+        fprintf (stderr, "alpha %d, BGR %d %d %d: got RGB %d %d %d\n",
+                 s[3], s[0], s[1], s[2], d[0], d[1], d[2]);
+      ++bad;
+    }
+  }
+  freeConvContext (&ctx);
+  if (bad)
+  {
+    fprintf (stderr, "%d of 65536 pixels differ.\n", bad);
+    return 1;
+  }
+  return 0;
+}
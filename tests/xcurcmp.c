@@ -0,0 +1,141 @@
+/* Copyright (C) 2008-2009 tks
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/* Compare pixels of an Xcursor with the Xcursor rebuilt from its
+ * config-file and PNGs, used by roundtrip.sh.
+ * Usage: xcurcmp original rebuilt
+ * Prints number of pixels, largest and mean error of color channels.
+ * Images must have the same order, sizes, hot spots, delays and alpha.
+ * return 0 if they have, 1 if not, 99 if a file cannot be read. */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "libxcur2png-private.h"
+
+static unsigned char *readFile (const char *name, size_t *lengthp)
+{ /* return whole file in memory, which must be freed later. */
+  FILE *fp = fopen (name, "rb");
+  unsigned char *data = NULL;
+  size_t size = 0, length = 0, n;
+  if (!fp)
+  {
+    perror (name);
+    return NULL;
+  }
+  do
+  {
+    if (length == size)
+    {
+      unsigned char *tmp = realloc (data, size = size * 2 + 65536);
+      if (!tmp)
+      {
+        free (data);
+        fclose (fp);
+        fprintf (stderr, "Cannot allocate memory for \"%s\".\n", name);
+        return NULL;
+      }
+      data = tmp;
+    }
+    n = fread (data + length, 1, size - length, fp);
+    length += n;
+  } while (n > 0);
+  fclose (fp);
+  *lengthp = length;
+  return data;
+}
+
+int main (int argc, char *argv[])
+{
+  unsigned char *data[2];
+  size_t length[2];
+  xcurFile xf[2];
+  xcurImage a, b;
+  xcur2pngOptions options;
+  unsigned long long pixels = 0, sum = 0;
+  int max = 0;
+  int ret = 0;
+  int i, c, e;
+  size_t p;
+
+  if (argc != 3)
+  {
+    fprintf (stderr, "Usage: %s original rebuilt\n", argv[0]);
+    return 99;
+  }
+  xcur2pngInitOptions (&options);
+  for (i = 0; i < 2; ++i)
+  {
+    data[i] = readFile (argv[i + 1], &length[i]);
+    if (!data[i])
+      return 99;
+    xf[i].mapped = 0;
+    if (!parseXcursor (&xf[i], data[i], length[i], &options))
+    {
+      fprintf (stderr, "\"%s\" is not a valid Xcursor.\n", argv[i + 1]);
+      return 99;
+    }
+  }
+  if (xf[0].nimage != xf[1].nimage)
+  {
+    fprintf (stderr, "%d images instead of %d.\n", xf[1].nimage,
+             xf[0].nimage);
+    ret = 1;
+  }
+  for (i = 0; i < xf[0].nimage && i < xf[1].nimage; ++i)
+  {
+    getXcursorImage (&xf[0], i, &a);
+    getXcursorImage (&xf[1], i, &b);
+    if (a.size != b.size || a.width != b.width || a.height != b.height ||
+        a.xhot != b.xhot || a.yhot != b.yhot || a.delay != b.delay)
+    {
+      fprintf (stderr, "Header of image %d differs.\n", i);
+      ret = 1;
+    }
+    else
+    { /* BGRA bytes. alpha is never changed by round trip. */
+      for (p = 0; p < (size_t) a.width * a.height * 4; p += 4)
+      {
+        if (a.pixels[p + 3] != b.pixels[p + 3])
+        {
+          fprintf (stderr, "Alpha of image %d differs.\n", i);
+          ret = 1;
+          break;
+        }
+        for (c = 0; c < 3; ++c)
+        {
+          e = (int) a.pixels[p + c] - (int) b.pixels[p + c];
+          if (e < 0)
+            e = -e;
+          if (e > max)
+            max = e;
+          sum += e;
+        }
+      }
+      pixels += (size_t) a.width * a.height;
+    }
+    releaseXcursorImage (&xf[0], &a);
+    releaseXcursorImage (&xf[1], &b);
+  }
+  printf ("%llu %d %f\n", pixels, max,
+          pixels ? (double) sum / (pixels * 3) : 0.0);
+  for (i = 0; i < 2; ++i)
+  {
+    freeXcursor (&xf[i]);
+    free (data[i]);
+  }
+  return ret;
+}
@@ -13,7 +13,6 @@
  * You should have received a copy of the GNU General Public License
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
-/* Todo: atoi error handling */
 /* help is -h in manual */
 
 #include <config.h>
@@ -22,24 +21,92 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 #include <errno.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
 #include <limits.h>
 #include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #define _GNU_SOURCE
 #include <getopt.h>
 /* Need to use libpng > ver 1.0.6 */
 #include <png.h>
+#include <zlib.h>
 #include <X11/Xcursor/Xcursor.h>
+#include "libxcur2png-private.h"
 
 #define PNG_SETJMP_NOT_SUPPORTED 1
 
 #define PROGRESS_SHARPS 50 /* total number of progress sharps */
+#define CONF_LINE_MAX 4096 /* max length of a line of config-file */
+#define MANIFEST_NAME ".xcur2png-manifest" /* manifest file of --incremental */
+#define MANIFEST_HEADER "xcur2png manifest 1\n"
+#define WRITE_QUEUE_MAX (16 * 1024 * 1024) /* max bytes waiting to be written */
+
+/* values of long options which have no short option. */
+enum LONG_OPTION {
+  OPT_DEDUPE = 256,
+  OPT_COMPRESSION,
+  OPT_ZLIB_LEVEL,
+  OPT_PNG_FILTER,
+  OPT_STATS,
+  OPT_ATLAS,
+  OPT_APNG,
+  OPT_REVERSE,
+  OPT_SIZE,
+  OPT_FRAMES,
+  OPT_ARCHIVE,
+  OPT_ARCHIVE_FILE,
+  OPT_INCREMENTAL,
+  OPT_SUFFIX_WIDTH,
+  OPT_WRITE_THREADS,
+  OPT_FORMAT,
+  OPT_SERVE,
+  OPT_CONNECT,
+  OPT_CHECK,
+  OPT_STORE
+};
+
+/* formats of --archive. */
+enum ARCHIVE_FORMAT {
+  ARCHIVE_NONE,
+  ARCHIVE_TAR,
+  ARCHIVE_ZIP
+};
 
 int quiet = 0; /* 1: output is quiet, 0: not quiet */
 int dry_run = 0; /* 1:don't output PNGs and conf is output to stdout. */
+int batch = 0; /* 1: more than one Xcursor is converted in this process. */
+int atlas = 0; /* 1: images of each nominal size are packed into one PNG. */
+int apng = 0; /* 1: images of each nominal size are written to one APNG. */
+int reverse = 0; /* 1: Xcursor is built from config-file and PNGs. */
+int incremental = 0; /* 1: unchanged Xcursors and images are not written. */
+int suffix_width = 3; /* suffix of PNG is zero-padded to this width. */
+int write_threads = 0; /* threads which write PNGs. 0: written by encoder. */
+char *serve_socket = NULL; /* --serve: socket which conversions are served on. */
+char *connect_socket = NULL; /* --connect: socket of xcur2png --serve. */
+int check = 0; /* 1: Xcursors are only checked and nothing is written. */
+char *store_dir = NULL; /* --store: images are named by hash of pixels. */
+mode_t store_umask; /* umask which objects of --store are created with. */
+/* compression, --size, --frames and --dedupe. set by parseOptions. */
+xcur2pngOptions conv_options;
+FILE *stats_strm = NULL; /* stream to write statistics. NULL if not needed. */
+pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+/* roundTripError[alpha][value] is difference between premultiplied value
+ * of Xcursor and that of Xcursor rebuilt from PNG by --reverse. Set once by
+ * initRoundTripError, and never changed after that. */
+unsigned char roundTripError[256][256];
+pthread_once_t roundTripOnce = PTHREAD_ONCE_INIT;
 
 #define VERBOSE_PRINT(...) \
   if (!quiet) { fprintf (stderr, __VA_ARGS__); }
@@ -58,19 +125,234 @@ typedef struct {
   int length;  /* length of directory name, used only if state is DOWN. */
 } dirNameS ;
 
-void parseOptions (int argc, char *argv[], char **confp,
-                   char **dirp, int *suffixp, const char **cursorp);
+typedef struct {
+  pthread_mutex_t lock;
+  int next;    /* index of the next job which is not taken by any worker. */
+  int total;   /* number of jobs. */
+  void (*func) (int index, int worker, void *arg);
+  void *arg;
+} jobQueue ;
+
+typedef struct {
+  jobQueue *queue;
+  int worker;  /* 0 to jobs - 1. Each worker has its own number. */
+} jobWorkerArg ;
+
+typedef struct {
+  char *name;
+  XcursorUInt crc;
+  XcursorUInt size;
+  XcursorUInt offset;     /* offset of local file header. */
+  XcursorUInt mode;       /* mode of file or symbolic link. */
+} zipEntry ;
+
+typedef struct {
+  int format;             /* ARCHIVE_NONE, ARCHIVE_TAR or ARCHIVE_ZIP. */
+  FILE *fp;               /* stream of archive. */
+  pthread_mutex_t lock;   /* entries are written one at a time. */
+  unsigned long offset;   /* bytes written to fp. */
+  time_t mtime;           /* modification time of entries. */
+  zipEntry *entries;      /* entries of zip written so far. */
+  int nentry;
+  int maxEntry;           /* allocated number of entries. */
+  int failed;             /* 1 if writing to fp failed. */
+} archiveS ;
+
+/* archive which files are written to instead of directory. */
+archiveS archive = {ARCHIVE_NONE, NULL, PTHREAD_MUTEX_INITIALIZER};
+
+typedef struct {
+  char *name;             /* path of PNG. */
+  uint64_t hash;          /* hash of image in PNG. 0 if PNG has more than
+                             one image (atlas or APNG). */
+} manifestPng ;
+
+typedef struct {
+  char *cursor;           /* path of Xcursor. */
+  char *conf;             /* path of config-file. */
+  unsigned long long size;      /* size and modification time of Xcursor. */
+  struct timespec mtime;
+  uint64_t hash;          /* hash of whole Xcursor. */
+  manifestPng *pngs;      /* PNGs written from Xcursor. */
+  int npng;
+} manifestEntry ;
+
+typedef struct {
+  char *path;             /* path of manifest file. */
+  char *options;          /* options line. Manifest written with other
+                             options or in other directory is not used. */
+  manifestEntry *entries; /* Xcursors converted successfully. */
+  int nentry;
+  int maxEntry;           /* allocated number of entries. */
+  pthread_mutex_t lock;   /* lock for entries. */
+} manifestS ;
+
+/* manifest of --incremental, kept in output directory. */
+manifestS manifest = {NULL, NULL, NULL, 0, 0, PTHREAD_MUTEX_INITIALIZER};
+
+typedef struct {
+  int pending;            /* number of files queued but not written yet. */
+  int failed;             /* 1 if any file could not be written. */
+} writeGroup ;            /* files of a Xcursor. protected by writer.lock. */
+
+typedef struct writeRequestS {
+  char *name;
+  unsigned char *data;    /* copy of data, freed after it is written. */
+  size_t length;
+  writeGroup *group;
+  struct writeRequestS *next;
+} writeRequest ;
+
+typedef struct {
+  pthread_t *threads;
+  int nthreads;           /* 0 if files are written synchronously. */
+  pthread_mutex_t lock;
+  pthread_cond_t queued;  /* signaled when a request is queued or stopped. */
+  pthread_cond_t written; /* signaled when a request is written. */
+  writeRequest *head;     /* requests are written in order they are queued. */
+  writeRequest *tail;
+  size_t bytes;           /* bytes of requests queued or being written. */
+  int stopped;            /* 1 if threads must exit when queue is empty. */
+} writerS ;
+
+/* threads which write PNGs while next images are encoded. */
+writerS writer = {NULL, 0, PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER,
+                  PTHREAD_COND_INITIALIZER};
+
+typedef struct {
+  char **cursors;         /* Xcursors to be converted. */
+  const char *argconf;
+  const char *out;
+  int suffix;
+  const char *cwd;
+  convContext *ctxs;      /* a conversion context for each worker. */
+  int *results;           /* return values of convertCursor for each Xcursor. */
+  const int *primary;     /* index of Xcursor which each Xcursor is alias of. */
+  int ncursors;
+  int done;               /* number of Xcursors already converted. */
+  pthread_mutex_t lock;   /* lock for done and progress. */
+  FILE **requests;        /* --connect: stream to server of each worker. */
+  FILE **answers;         /* --connect: stream from server of each worker. */
+} batchArgs ;
+
+typedef struct {
+  int fd;                 /* listening socket of --serve. */
+  convContext *ctxs;      /* a conversion context for each thread. They are
+                             kept between requests. */
+} serveArgs ;
+
+typedef struct {
+  int image;            /* index of image in Xcursor. */
+  XcursorDim width;
+  XcursorDim height;
+  double convert;       /* seconds to un-premultiply pixels. */
+  double encode;        /* seconds to encode PNG in memory. */
+  double write;         /* seconds to write PNG to file. */
+  size_t bytes;         /* bytes of PNG. */
+  int maxError;         /* the largest error of a channel after round trip
+                           through PNG and --reverse. */
+  uint64_t errorSum;    /* sum of errors of all channels. */
+  uint64_t channels;    /* number of channels errors are summed for. */
+} frameStats ;
+
+typedef struct {
+  double read;          /* seconds to map and parse Xcursor. */
+  double conf;          /* seconds to write config-file. */
+  double total;         /* seconds to convert whole Xcursor. */
+  size_t bytesRead;     /* bytes of Xcursor. */
+  int nimage;           /* number of images in Xcursor. */
+  int npng;             /* number of PNGs. */
+  int filesCreated;
+  frameStats *frames;   /* statistics of each PNG. */
+} cursorStats ;
+
+typedef struct {
+  int columns;            /* number of cells in a row. */
+  XcursorDim cellWidth;   /* width of a cell. the widest image fits in it. */
+  XcursorDim cellHeight;  /* height of a cell. */
+} atlasLayout ;
+
+typedef struct {
+  const xcurFile *xf;
+  /* function which writes a group of images to a file. */
+  int (*write) (convContext *ctx, const xcurFile *xf, const int *members,
+                int n, const atlasLayout *layout, const char *pngName,
+                frameStats *stats, writeGroup *writes);
+  const int *members;     /* images grouped by nominal size. */
+  const int *starts;      /* members of group g are from starts[g] to
+                             starts[g + 1] - 1. */
+  const atlasLayout *layouts;  /* layout of each group. */
+  const char *xcurFilePart;
+  int suffix;
+  const char *outdir;
+  convContext *ctxs;
+  frameStats *stats;
+  writeGroup *writes;     /* atlases and APNGs queued to writer. */
+  int failed;
+  pthread_mutex_t lock;
+} groupArgs ;
+
+typedef struct {
+  const xcurFile *xf;
+  const int *indices;     /* index of image written to each PNG. */
+  int total;              /* number of PNGs. */
+  const char *xcurFilePart;
+  int suffix;
+  const char *outdir;
+  convContext *ctxs;      /* a conversion context for each worker. */
+  frameStats *stats;      /* statistics of each PNG. NULL if not needed. */
+  const manifestEntry *old;  /* manifest of last conversion. NULL if not
+                                --incremental. */
+  manifestEntry *entry;   /* manifest of this conversion. */
+  writeGroup *writes;     /* PNGs queued to writer. */
+  int failed;             /* 1 if any PNG could not be written. */
+  int done;               /* number of PNGs already written. */
+  int skipped;            /* number of PNGs which are not changed. */
+  char (*objects)[IMAGE_DIGEST_LENGTH * 2 + 1];
+                          /* name of object of store (SHA-256 of pixels in
+                             hex) of each PNG. NULL if not --store. */
+  pthread_mutex_t lock;   /* lock for failed, done and progress. */
+} frameArgs ;
+
+typedef struct {
+  XcursorDim size;
+  XcursorDim xhot;
+  XcursorDim yhot;
+  XcursorUInt delay;
+  char *path;             /* path to PNG image. */
+  int line;               /* line number in config-file. */
+  XcursorDim width;       /* width and height are set when PNG is decoded. */
+  XcursorDim height;
+  unsigned char *pixels;  /* premultiplied ARGB in little endian. */
+} confEntry ;
+
+typedef struct {
+  confEntry *entries;
+  int total;              /* number of entries. */
+  int failed;             /* 1 if any PNG could not be decoded. */
+  int done;               /* number of PNGs already decoded. */
+  pthread_mutex_t lock;   /* lock for failed, done and progress. */
+} decodeArgs ;
+
+void parseOptions (int argc, char *argv[], char **confp, char **dirp,
+                   int *suffixp, int *jobsp, char ***cursorsp, int *ncursorsp);
 void printUsage (int status);
+void setCompression (const char *preset);
+int parsePngFilters (const char *arg);
+int parseNumber (const char *arg, long min, long max, const char *what);
+void parseSizes (const char *arg);
+void parseFrames (const char *arg);
 void removeLastSlash (char *string);
 const char *rawName (const char *cursor);
-char *makeConfPath (char *conf, const char *rawname);
+char *makeConfPath (const char *conf, const char *rawname);
 FILE *openConfStream (const char *conf);
+int checkDirectory (const char *dir);
 void dirIsWritable (const char *dir);
 char *getPrefixFromConfToOut (const char *conf, const char *out,
                                     const char *cwd);
 int countSlashes (const char *string);
 void appartDirName (dirNameS retArray[], int max, const char *string);
-void trimDirName (dirNameS Array[]);
+int trimDirName (dirNameS Array[]);
 void killCommonPart (dirNameS a[], dirNameS b[]);
 void reverseDirName (dirNameS Array[], const char *cwd);
 void setStateOfDirNameS (dirNameS *dir);
@@ -78,22 +360,141 @@ void initializeDirName (dirNameS Array[], int len);
 char *writePathFromDirNames (dirNameS a[], dirNameS b[]);
 void writePathFromDirName (char **p, dirNameS a[]);
 int lengthOfDirName (dirNameS a[]);
-int saveConfAndPNGs (const XcursorImages *xcIs, const char *xcurFilePart,
+int saveConfAndPNGs (const xcurFile *xf, const char *xcurFilePart,
                      int suffix, FILE *conffp, const char *imagePrefix,
-                     const char *outdir);
+                     const char *outdir, convContext *ctxs, int jobs,
+                     cursorStats *stats, const manifestEntry *old,
+                     manifestEntry *entry);
+void saveFrameJob (int index, int worker, void *arg);
 void printProgress (int num, int total);
-int writePngFileFromXcur (const XcursorDim width, const XcursorDim height,
-                          const XcursorPixel* pixels, const char* pngName);
+char **expandCursors (char *args[], int nargs, int *ncursorsp);
+int findAliases (char **cursors, int ncursors, int *primary);
+const unsigned char *mapFile (const char *path, size_t *lengthp);
+int sameContents (const char *a, const char *b);
+int linkAlias (const char *alias, const char *cursor, const char *argconf);
+int convertCursor (const char *cursor, const char *argconf, const char *out,
+                   const char *argprefix, int suffix, const char *cwd,
+                   convContext *ctxs, int jobs);
+void runJobs (int total, int jobs,
+              void (*func) (int index, int worker, void *arg), void *arg);
+void *jobWorker (void *workerArg);
+void convertBatchJob (int index, int worker, void *arg);
+int connectSocket (const char *path);
+int openServerSocket (const char *path);
+void stopServer (int sig);
+void serveConnection (int fd, convContext *ctx);
+void serveJob (int index, int worker, void *arg);
+int serve (int jobs);
+char *absolutePath (const char *path, const char *cwd);
+void connectServer (batchArgs *b, int n);
+void disconnectServer (batchArgs *b, int n);
+void convertRemoteJob (int index, int worker, void *arg);
+void printProblem (void *closure, const char *message);
+int checkCursors (char **cursors, int ncursors);
+int writeFileFromBuffer (const char *name, const unsigned char *data,
+                         size_t length);
+int writeStoreObject (const char *name, const unsigned char *data,
+                      size_t length);
+const char *archiveName (const char *name);
+int writeArchive (const void *data, size_t length);
+int addTarEntry (const char *name, const unsigned char *data, size_t length,
+                 int link);
+int addZipEntry (const char *name, const unsigned char *data, size_t length,
+                 int link);
+void putUInt16LE (unsigned char *p, unsigned int value);
+void dosDateTime (time_t t, unsigned int *datep, unsigned int *timep);
+int addArchiveEntry (const char *name, const unsigned char *data,
+                     size_t length);
+int addArchiveLink (const char *name, const char *target);
+int writeSymlink (const char *name, const char *target);
+void startWriter (int nthreads);
+void stopWriter (void);
+void *writerThread (void *arg);
+int queueFile (writeGroup *group, const char *name, const unsigned char *data,
+               size_t length);
+int waitWrites (writeGroup *group);
+int finishArchive (void);
+int writePngFileFromXcur (convContext *ctx, const XcursorDim width,
+                          const XcursorDim height, const unsigned char* pixels,
+                          const char* pngName, frameStats *stats,
+                          writeGroup *writes);
+int writeAtlasFromXcur (convContext *ctx, const xcurFile *xf,
+                        const int *members, int n, const atlasLayout *layout,
+                        const char *pngName, frameStats *stats,
+                        writeGroup *writes);
+void putUInt32BE (unsigned char *p, XcursorUInt value);
+int appendChunk (convContext *ctx, const char *type, long sequence,
+                 const unsigned char *data, size_t length);
+void setFrameDelay (unsigned char *fcTL, XcursorUInt delay);
+int writeApngFromXcur (convContext *ctx, const xcurFile *xf,
+                       const int *members, int n, const atlasLayout *layout,
+                       const char *pngName, frameStats *stats,
+                       writeGroup *writes);
+int groupBySize (const xcurFile *xf, int *members, int *starts);
+int saveConfAndGroupPNGs (const xcurFile *xf, const char *xcurFilePart,
+                          int suffix, FILE *conffp, const char *imagePrefix,
+                          const char *outdir, convContext *ctxs, int jobs,
+                          cursorStats *stats, manifestEntry *entry);
+void saveGroupJob (int index, int worker, void *arg);
+int buildXcursor (const char *conf, const char *out, int jobs);
+int readConf (const char *conf, confEntry **entriesp);
+void decodePngJob (int index, int worker, void *arg);
+int readPngFile (confEntry *entry);
+void premultiplyPixels (unsigned char *pixels, size_t n);
+void putUInt32LE (unsigned char *p, XcursorUInt value);
+int writeXcursorFile (const char *name, const confEntry *entries, int n);
+void loadManifest (const char *out, const char *cwd, int suffix);
+int readManifestLine (char *line);
+char *nextField (char **p);
+int saveManifest (void);
+int compareManifestEntries (const void *a, const void *b);
+int takeManifestEntry (const char *cursor, manifestEntry *entry);
+void putManifestEntry (manifestEntry *entry);
+void freeManifestEntry (manifestEntry *entry);
+int cursorIsUnchanged (const manifestEntry *old, const char *conf,
+                       const struct stat *st, const uint64_t *hash);
+int pngIsUnchanged (const manifestEntry *old, int index, const char *name,
+                    uint64_t hash);
+uint64_t hashData (const unsigned char *data, size_t length);
+int openXcursorFile (xcurFile *xf, const char *path);
+void closeXcursorFile (xcurFile *xf);
+void initRoundTripError (void);
+void addRoundTripError (frameStats *stats, const unsigned char *pixels,
+                        size_t n);
+void addGroupError (frameStats *stats, const xcurFile *xf, const int *members,
+                    int n);
+double now (void);
+void printJsonString (FILE *fp, const char *str);
+void printStats (const char *cursor, int ok, const cursorStats *stats,
+                 int allocations);
 
 
-void parseOptions (int argc, char* argv[], char** confp,
-                   char** dirp, int* suffixp, const char** cursorp)
+void parseOptions (int argc, char* argv[], char** confp, char** dirp,
+                   int* suffixp, int* jobsp, char*** cursorsp, int* ncursorsp)
 {
   int ret;
   extern char *optarg;
   extern int optind;
   extern int quiet;
   extern int dry_run;
+  extern xcur2pngOptions conv_options;
+  extern FILE *stats_strm;
+  extern archiveS archive;
+  extern int atlas;
+  extern int apng;
+  extern int reverse;
+  extern int incremental;
+  extern int suffix_width;
+  extern int write_threads;
+  extern char *serve_socket;
+  extern char *connect_socket;
+  extern int check;
+  extern char *store_dir;
+  const char *archiveFile = "-";
+  char *end;
+  long value;
+  int level = -2;   /* set by --zlib-level. */
+  int filters = -2; /* set by --png-filter. */
   const struct option longopts[] =
   {
     {"version",         no_argument,            NULL,   'V'},
@@ -103,10 +504,31 @@ void parseOptions (int argc, char* argv[], char** confp,
     {"initial-suffix",  required_argument,      NULL,   'i'},
     {"quiet",           no_argument,            NULL,   'q'},
     {"dry-run",         no_argument,            NULL,   'n'},
+    {"jobs",            required_argument,      NULL,   'j'},
+    {"dedupe",          no_argument,            NULL,   OPT_DEDUPE},
+    {"compression",     required_argument,      NULL,   OPT_COMPRESSION},
+    {"zlib-level",      required_argument,      NULL,   OPT_ZLIB_LEVEL},
+    {"png-filter",      required_argument,      NULL,   OPT_PNG_FILTER},
+    {"stats",           optional_argument,      NULL,   OPT_STATS},
+    {"atlas",           no_argument,            NULL,   OPT_ATLAS},
+    {"apng",            no_argument,            NULL,   OPT_APNG},
+    {"reverse",         no_argument,            NULL,   OPT_REVERSE},
+    {"size",            required_argument,      NULL,   OPT_SIZE},
+    {"frames",          required_argument,      NULL,   OPT_FRAMES},
+    {"archive",         required_argument,      NULL,   OPT_ARCHIVE},
+    {"archive-file",    required_argument,      NULL,   OPT_ARCHIVE_FILE},
+    {"incremental",     no_argument,            NULL,   OPT_INCREMENTAL},
+    {"suffix-width",    required_argument,      NULL,   OPT_SUFFIX_WIDTH},
+    {"write-threads",   required_argument,      NULL,   OPT_WRITE_THREADS},
+    {"format",          required_argument,      NULL,   OPT_FORMAT},
+    {"serve",           required_argument,      NULL,   OPT_SERVE},
+    {"connect",         required_argument,      NULL,   OPT_CONNECT},
+    {"check",           no_argument,            NULL,   OPT_CHECK},
+    {"store",           required_argument,      NULL,   OPT_STORE},
     {NULL,              0,                      NULL,     0}
   };
 
-  while (ret = getopt_long (argc, argv, "Vhc:d:i:qn", longopts, NULL))
+  while (ret = getopt_long (argc, argv, "Vhc:d:i:qnj:", longopts, NULL))
   {
     if (ret == -1)
       break;
@@ -132,17 +554,28 @@ void parseOptions (int argc, char* argv[], char** confp,
       case 'i':
         if (!optarg)
           printUsage(2);
-        *suffixp = atoi (optarg);
-        if (*suffixp >= 999)
+        value = strtol (optarg, &end, 10);
+        if (end == optarg || *end || value > INT_MAX)
         {
-          fprintf (stderr, "Initial suffix must be less than 1000!\n");
+          fprintf (stderr, "Invalid initial suffix \"%s\"!\n", optarg);
           exit (2);
         }
-        else if (*suffixp < 0)
+        else if (value < 0)
         {
           fprintf (stderr, "Initial suffix must be positive!\n");
           exit (2);
         }
+        *suffixp = value;
+        break;
+      case OPT_WRITE_THREADS:
+        if (!optarg)
+          printUsage(2);
+        write_threads = parseNumber (optarg, 0, 64, "number of write threads");
+        break;
+      case OPT_SUFFIX_WIDTH:
+        if (!optarg)
+          printUsage(2);
+        suffix_width = parseNumber (optarg, 1, 10, "suffix width");
         break;
       case 'q':
         if (quiet == 1)
@@ -154,6 +587,138 @@ void parseOptions (int argc, char* argv[], char** confp,
           printUsage(2);
         dry_run = 1;
         break;
+      case 'j':
+        if (!optarg)
+          printUsage(2);
+        *jobsp = parseNumber (optarg, 0, 1024, "number of jobs");
+        if (*jobsp == 0)
+        { /* 0 means the number of online processors. */
+          long ncpu = sysconf (_SC_NPROCESSORS_ONLN);
+          *jobsp = (ncpu > 0) ? (int) ncpu : 1;
+        }
+        break;
+      case OPT_DEDUPE:
+        if (conv_options.dedupe == 1)
+          printUsage(2);
+        conv_options.dedupe = 1;
+        break;
+      case OPT_COMPRESSION:
+        if (!optarg)
+          printUsage(2);
+        setCompression (optarg);
+        break;
+      case OPT_ZLIB_LEVEL:
+        if (!optarg)
+          printUsage(2);
+        level = parseNumber (optarg, 0, 9, "zlib level");
+        break;
+      case OPT_PNG_FILTER:
+        if (!optarg)
+          printUsage(2);
+        filters = parsePngFilters (optarg);
+        break;
+      case OPT_ATLAS:
+        if (atlas == 1)
+          printUsage(2);
+        atlas = 1;
+        break;
+      case OPT_APNG:
+        if (apng == 1)
+          printUsage(2);
+        apng = 1;
+        break;
+      case OPT_SIZE:
+        if (!optarg || conv_options.nsizes)
+          printUsage(2);
+        parseSizes (optarg);
+        break;
+      case OPT_FRAMES:
+        if (!optarg)
+          printUsage(2);
+        parseFrames (optarg);
+        break;
+      case OPT_ARCHIVE:
+        if (!optarg || archive.format != ARCHIVE_NONE)
+          printUsage(2);
+        if (strcmp (optarg, "tar") == 0)
+          archive.format = ARCHIVE_TAR;
+        else if (strcmp (optarg, "zip") == 0)
+          archive.format = ARCHIVE_ZIP;
+        else
+        {
+          fprintf (stderr, "Unknown archive format \"%s\"!\n", optarg);
+          exit (2);
+        }
+        break;
+      case OPT_FORMAT:
+        if (!optarg)
+          printUsage(2);
+        if (strcmp (optarg, "png") == 0)
+          conv_options.format = XCUR2PNG_FORMAT_PNG;
+        else if (strcmp (optarg, "qoi") == 0)
+          conv_options.format = XCUR2PNG_FORMAT_QOI;
+        else if (strcmp (optarg, "pam") == 0)
+          conv_options.format = XCUR2PNG_FORMAT_PAM;
+        else if (strcmp (optarg, "rgba") == 0)
+          conv_options.format = XCUR2PNG_FORMAT_RGBA;
+        else
+        {
+          fprintf (stderr, "Unknown image format \"%s\"!\n", optarg);
+          exit (2);
+        }
+        break;
+      case OPT_SERVE:
+        if (!optarg || serve_socket)
+          printUsage(2);
+        serve_socket = optarg;
+        break;
+      case OPT_CONNECT:
+        if (!optarg || connect_socket)
+          printUsage(2);
+        connect_socket = optarg;
+        break;
+      case OPT_CHECK:
+        if (check == 1)
+          printUsage(2);
+        check = 1;
+        break;
+      case OPT_STORE:
+        if (!optarg || store_dir)
+          printUsage(2);
+        store_dir = optarg;
+        break;
+      case OPT_ARCHIVE_FILE:
+        if (!optarg)
+          printUsage(2);
+        archiveFile = optarg;
+        break;
+      case OPT_INCREMENTAL:
+        if (incremental == 1)
+          printUsage(2);
+        incremental = 1;
+        break;
+      case OPT_REVERSE:
+        if (reverse == 1)
+          printUsage(2);
+        reverse = 1;
+        break;
+      case OPT_STATS:
+        if (stats_strm != NULL)
+          printUsage(2);
+        stats_strm = stderr;
+        if (optarg && strcmp (optarg, "-") == 0)
+          stats_strm = stdout;
+        else if (optarg)
+        {
+          stats_strm = fopen (optarg, "w");
+          if (!stats_strm)
+          {
+            int e = errno;
+            fprintf (stderr, "Cannot open \"%s\":%s\n", optarg, strerror (e));
+            exit (1);
+          }
+        }
+        break;
       case '?':
         printUsage(2);
         break;
@@ -162,17 +727,125 @@ void parseOptions (int argc, char* argv[], char** confp,
     }
   }
 
-  if (optind < argc - 1)
+  if ((atlas || apng) && conv_options.dedupe)
+  {
+    fprintf (stderr, "--dedupe cannot be used with --atlas or --apng!\n");
+    exit (2);
+  }
+  if (atlas && apng)
+  {
+    fprintf (stderr, "--atlas cannot be used with --apng!\n");
+    exit (2);
+  }
+  if (apng && conv_options.format != XCUR2PNG_FORMAT_PNG)
+  {
+    fprintf (stderr, "--apng cannot be used with --format other than png!\n");
+    exit (2);
+  }
+  if (reverse && (*confp || atlas || apng || conv_options.dedupe ||
+                  stats_strm || conv_options.nsizes || archive.format ||
+                  conv_options.firstFrame || conv_options.lastFrame != -1 ||
+                  incremental || conv_options.format != XCUR2PNG_FORMAT_PNG))
   {
-    fprintf (stderr, "You can specify only one Xcursor at a time\n");
+    fprintf (stderr, "--reverse cannot be used with -c, --atlas, --apng, "
+             "--dedupe, --stats, --size, --frames, --archive, "
+             "--incremental or --format!\n");
+    exit (2);
+  }
+  if (check && (*confp || *dirp || *suffixp || dry_run || *jobsp != 1 ||
+                reverse || incremental || archive.format || atlas || apng ||
+                stats_strm || conv_options.dedupe || conv_options.nsizes ||
+                conv_options.firstFrame || conv_options.lastFrame != -1 ||
+                conv_options.format || conv_options.zlibLevel != -1 ||
+                conv_options.zlibStrategy != -1 ||
+                conv_options.pngFilters != -1 || level != -2 || filters != -2 ||
+                suffix_width != 3 || write_threads != 0 || serve_socket ||
+                connect_socket))
+  { /* nothing is converted. */
+    fprintf (stderr, "--check can be used only with -q!\n");
+    exit (2);
+  }
+  if (store_dir && (*dirp || *suffixp || suffix_width != 3 || reverse ||
+                    incremental || archive.format || atlas || apng ||
+                    serve_socket || connect_socket || check))
+  { /* images are named by their pixels and written to store. */
+    fprintf (stderr, "--store cannot be used with -d, -i, --suffix-width, "
+             "--reverse, --incremental, --archive, --atlas, --apng, "
+             "--serve, --connect or --check!\n");
+    exit (2);
+  }
+  if (store_dir)
+    *dirp = store_dir;
+  if (incremental && (dry_run || archive.format ||
+                      (*confp && strcmp (*confp, "-") == 0)))
+  { /* files of last conversion must be on disk to be kept. */
+    fprintf (stderr, "--incremental cannot be used with -n, -c - or --archive!\n");
+    exit (2);
+  }
+  if (archive.format != ARCHIVE_NONE)
+  { /* open archive. config-file is written to it, so it cannot be "-". */
+    if (dry_run || (*confp && strcmp (*confp, "-") == 0))
+    {
+      fprintf (stderr, "--archive cannot be used with -n or -c -!\n");
+      exit (2);
+    }
+    archive.fp = stdout;
+    if (strcmp (archiveFile, "-") != 0)
+    {
+      archive.fp = fopen (archiveFile, "wb");
+      if (!archive.fp)
+      {
+        int e = errno;
+        fprintf (stderr, "Cannot open \"%s\":%s\n", archiveFile, strerror (e));
+        exit (1);
+      }
+    }
+    else if (stats_strm == stdout)
+    {
+      fprintf (stderr, "Archive and statistics cannot be written to standard output at once!\n");
+      exit (2);
+    }
+    archive.mtime = time (NULL);
+  }
+  /* explicit level and filter take precedence over --compression. */
+  if (level != -2)
+    conv_options.zlibLevel = level;
+  if (filters != -2)
+    conv_options.pngFilters = filters;
+  if (serve_socket && (connect_socket || reverse || incremental || dry_run ||
+                       archive.format || *confp || *dirp || *suffixp ||
+                       optind < argc))
+  { /* each request gives its own Xcursor, config-file, directory and
+     * suffix. */
+    fprintf (stderr, "--serve cannot be used with --connect, --reverse, "
+             "--incremental, -n, --archive, -c, -d, -i or Xcursor!\n");
+    exit (2);
+  }
+  if (connect_socket && (reverse || incremental || dry_run || archive.format ||
+                         atlas || apng || stats_strm || conv_options.dedupe ||
+                         conv_options.nsizes || conv_options.firstFrame ||
+                         conv_options.lastFrame != -1 || conv_options.format ||
+                         conv_options.zlibLevel != -1 ||
+                         conv_options.zlibStrategy != -1 ||
+                         conv_options.pngFilters != -1 || suffix_width != 3 ||
+                         (*confp && strcmp (*confp, "-") == 0)))
+  { /* images are converted with options given to the server. */
+    fprintf (stderr, "--connect can be used only with -c, -d, -i, -q and -j!\n");
     exit (2);
   }
+  if (serve_socket)
+    return;
+
   if (optind > argc - 1)
   {
-    fprintf (stderr, "Target Xcursor is not specified!\n");
+    if (reverse)
+      fprintf (stderr, "Config-file is not specified!\n");
+    else
+      fprintf (stderr, "Target Xcursor is not specified!\n");
     exit (2);
   }
-  *cursorp = argv[optind];
+  *cursorsp = argv + optind;
+  *ncursorsp = argc - optind;
   if (dry_run)
   { /* if --dry-run specified, conf is output to stdout and be quiet. */
     *confp = "-";
@@ -183,8 +856,13 @@ void parseOptions (int argc, char* argv[], char** confp,
 
 void printUsage (int status)
 { /* print usage and exit with status */
-  fprintf(stderr,"usage: xcur2png [OPTION] [Xcursor file]\n");
+  fprintf(stderr,"usage: xcur2png [OPTION] [Xcursor file]...\n");
+  fprintf(stderr,"  or:  xcur2png --reverse [OPTION] [config-file]...\n");
+  fprintf(stderr,"  or:  xcur2png --serve [socket] [OPTION]\n");
+  fprintf(stderr,"  or:  xcur2png --connect [socket] [OPTION] [Xcursor file]...\n");
+  fprintf(stderr,"  or:  xcur2png --check [-q] [Xcursor file]...\n");
   fprintf(stderr,"Take PNG images from Xcursor and generate xcursorgen config-file\n");
+  fprintf(stderr,"or build Xcursor from config-file and PNG images.\n");
   fprintf(stderr,"\n");
   fprintf(stderr,"  -V, --version            display the version number and exit\n");
   fprintf(stderr,"  -h, --help               display this message and exit\n");
@@ -192,20 +870,203 @@ void printUsage (int status)
   fprintf(stderr,"                           by xcursorgen\n");
   fprintf(stderr,"  -d, --directory [dir]    directory where PNG images are saved.\n");
   fprintf(stderr,"  -i, --initial-suffix [n] initial suffix which is attached to PNG\n");
+  fprintf(stderr,"      --suffix-width [w]   zero-pad suffix of PNG to [w] digits (3).\n");
   fprintf(stderr,"  -q, --quiet              suppress progress message.\n");
   fprintf(stderr,"  -n, --dry-run            don't output images and config-file to files.\n");
+  fprintf(stderr,"  -j, --jobs [n]           convert up to [n] Xcursors or images at once.\n");
+  fprintf(stderr,"      --write-threads [n]  write PNGs with [n] threads while next ones are\n");
+  fprintf(stderr,"                           encoded. 0 writes them in encoder (0).\n");
+  fprintf(stderr,"      --dedupe             write identical images to one PNG only once.\n");
+  fprintf(stderr,"      --compression [c]    PNG compression preset: fast, default or small.\n");
+  fprintf(stderr,"      --zlib-level [l]     zlib compression level (0-9).\n");
+  fprintf(stderr,"      --png-filter [f]     PNG filters: none, sub, up, avg, paeth or all.\n");
+  fprintf(stderr,"                           Multiple filters can be joined with \',\'.\n");
+  fprintf(stderr,"      --format [f]         image format: png, qoi, pam or rgba (png).\n");
+  fprintf(stderr,"      --stats[=file]       write statistics of conversion as JSON.\n");
+  fprintf(stderr,"      --atlas              pack images of each size into one PNG and\n");
+  fprintf(stderr,"                           write index of them instead of config-file.\n");
+  fprintf(stderr,"      --apng               write images of each size to one APNG.\n");
+  fprintf(stderr,"      --reverse            build Xcursor from xcursorgen config-file.\n");
+  fprintf(stderr,"      --size [s,...]       convert only images of nominal size [s].\n");
+  fprintf(stderr,"      --frames [a-b]       convert only frames [a] to [b] of each size.\n");
+  fprintf(stderr,"      --archive [format]   write PNGs and config-file to an archive.\n");
+  fprintf(stderr,"                           [format] is tar or zip.\n");
+  fprintf(stderr,"      --archive-file [f]   file of archive. standard output by default.\n");
+  fprintf(stderr,"      --incremental        don't convert Xcursors and images again which\n");
+  fprintf(stderr,"                           are not changed since last conversion.\n");
+  fprintf(stderr,"      --serve [socket]     stay resident and convert Xcursors requested\n");
+  fprintf(stderr,"                           through Unix domain socket [socket].\n");
+  fprintf(stderr,"      --connect [socket]   convert Xcursors by server of --serve.\n");
+  fprintf(stderr,"      --store [dir]        write images to [dir] named by hash of their\n");
+  fprintf(stderr,"                           pixels, only if they are not there yet.\n");
+  fprintf(stderr,"      --check              check headers of Xcursors against their file\n");
+  fprintf(stderr,"                           size and report problems. write nothing.\n");
   fprintf(stderr,"\n");
   fprintf(stderr,"If [conf] is \'-\', write to standard output.\n");
   fprintf(stderr,"If no [conf] is specified, raw-filename of [Xcursor file]\n");
   fprintf(stderr,"followed by \".conf\" is used.\n");
   fprintf(stderr,"If [dir] is not specified, current directory is used.\n");
-  fprintf(stderr,"[n] must be positive integer no more than 999.\n");
-  fprintf(stderr,"Make sure that when suffix go up to 999, then xcur2png stops.\n");
+  fprintf(stderr,"[n] must be positive integer.\n");
+  fprintf(stderr,"Suffix longer than [w] digits is not padded.\n");
+  fprintf(stderr,"If [Xcursor file] is a directory, all files in it are converted.\n");
+  fprintf(stderr,"If more than one Xcursor is converted, [conf] must be a directory\n");
+  fprintf(stderr,"or '-'.\n");
+  fprintf(stderr,"If [n] is 0, the number of processors is used.\n");
+  fprintf(stderr,"If [file] is not specified, statistics are written to standard error.\n");
+  fprintf(stderr,"Frames are counted from 0. If [b] is omitted, frames up to the last\n");
+  fprintf(stderr,"one are converted.\n");
+  fprintf(stderr,"With --reverse, Xcursor is written to [dir] and named after\n");
+  fprintf(stderr,"[config-file] without \".conf\".\n");
   exit (status);
 }
 
+void setCompression (const char *preset)
+{ /* set zlib level, strategy and PNG filters from preset name. */
+  extern xcur2pngOptions conv_options;
+  if (strcmp (preset, "fast") == 0)
+  { /* Cursors are mostly transparent, so unfiltered rows compress well
+     * and the adaptive filter selection is not worth its time. */
+    conv_options.zlibLevel = 1;
+    conv_options.zlibStrategy = -1;
+    conv_options.pngFilters = PNG_FILTER_NONE;
+  }
+  else if (strcmp (preset, "default") == 0)
+  {
+    conv_options.zlibLevel = -1;
+    conv_options.zlibStrategy = -1;
+    conv_options.pngFilters = -1;
+  }
+  else if (strcmp (preset, "small") == 0)
+  {
+    conv_options.zlibLevel = 9;
+    conv_options.zlibStrategy = Z_FILTERED;
+    conv_options.pngFilters = PNG_ALL_FILTERS;
+  }
+  else
+  {
+    fprintf (stderr, "Unknown compression \"%s\"!\n", preset);
+    exit (2);
+  }
+  return;
+}
+
+int parsePngFilters (const char *arg)
+{ /* return PNG filter flags of comma separated filter names. */
+  int ret = 0;
+  const char *p = arg;
+  while (*p)
+  {
+    size_t len = strcspn (p, ",");
+    if (len == 4 && strncmp (p, "none", 4) == 0)
+      ret |= PNG_FILTER_NONE;
+    else if (len == 3 && strncmp (p, "sub", 3) == 0)
+      ret |= PNG_FILTER_SUB;
+    else if (len == 2 && strncmp (p, "up", 2) == 0)
+      ret |= PNG_FILTER_UP;
+    else if (len == 3 && strncmp (p, "avg", 3) == 0)
+      ret |= PNG_FILTER_AVG;
+    else if (len == 5 && strncmp (p, "paeth", 5) == 0)
+      ret |= PNG_FILTER_PAETH;
+    else if (len == 3 && strncmp (p, "all", 3) == 0)
+      ret |= PNG_ALL_FILTERS;
+    else
+    {
+      fprintf (stderr, "Unknown PNG filter \"%s\"!\n", arg);
+      exit (2);
+    }
+    p += len;
+    if (*p == ',')
+      ++p;
+  }
+  if (ret == 0)
+  {
+    fprintf (stderr, "Unknown PNG filter \"%s\"!\n", arg);
+    exit (2);
+  }
+  return ret;
+}
+
+int parseNumber (const char *arg, long min, long max, const char *what)
+{ /* return arg as a number from min to max. exit with 2 if it is not. */
+  char *end;
+  long value;
+  errno = 0;
+  value = strtol (arg, &end, 10);
+  if (end == arg || *end || errno == ERANGE || value < min || value > max)
+  {
+    fprintf (stderr, "Invalid %s \"%s\"! It must be %ld to %ld.\n", what,
+             arg, min, max);
+    exit (2);
+  }
+  return value;
+}
+
+void parseSizes (const char *arg)
+{ /* set sizes of conv_options from comma separated nominal sizes. */
+  extern xcur2pngOptions conv_options;
+  const char *p = arg;
+  char *end;
+  long size;
+  XcursorDim *sizes = malloc ((strlen (arg) / 2 + 1) * sizeof (XcursorDim));
+  if (!sizes)
+  {
+    fprintf (stderr, "Cannot allocate memory for size \"%s\"!\n", arg);
+    exit (1);
+  }
+  while (*p)
+  {
+    size = strtol (p, &end, 10);
+    if (end == p || (*end != ',' && *end != '\0') ||
+        (*end == ',' && end[1] == '\0') || size <= 0 ||
+        size > XCURSOR_IMAGE_MAX_SIZE)
+    {
+      fprintf (stderr, "Invalid size \"%s\"!\n", arg);
+      exit (2);
+    }
+    sizes[conv_options.nsizes++] = size;
+    p = (*end == ',') ? end + 1 : end;
+  }
+  conv_options.sizes = sizes;
+  if (conv_options.nsizes == 0)
+  {
+    fprintf (stderr, "Invalid size \"%s\"!\n", arg);
+    exit (2);
+  }
+  return;
+}
+
+void parseFrames (const char *arg)
+{ /* set frames of conv_options from "a-b", "a-" or "a". */
+  extern xcur2pngOptions conv_options;
+  const char *p = arg;
+  char *end;
+  long first, last;
+  first = strtol (p, &end, 10);
+  last = first;
+  if (end != p && *end == '-' && end[1] == '\0')
+  { /* "a-" means frames from a to the last. */
+    last = -1;
+    ++end;
+  }
+  else if (end != p && *end == '-')
+  {
+    p = end + 1;
+    last = strtol (p, &end, 10);
+  }
+  if (end == p || *end != '\0' || first < 0 || first > INT_MAX ||
+      last > INT_MAX || (last != -1 && last < first))
+  {
+    fprintf (stderr, "Invalid frames \"%s\"!\n", arg);
+    exit (2);
+  }
+  conv_options.firstFrame = first;
+  conv_options.lastFrame = last;
+  return;
+}
+
 const char *rawName (const char *cursor)
-{
+{ /* return file name part of cursor. If cursor ends with '/', print so
+   * and return NULL. Nothing here exits, because server calls it too. */
   char *tmpchar = strrchr (cursor, '/');
   if (!tmpchar)
   {
@@ -214,34 +1075,39 @@ const char *rawName (const char *cursor)
   if (tmpchar[1] == '\0')
   {
     fprintf (stderr, "\"%s\" is not a file.\n", cursor);
-    exit(-1);
+    return NULL;
   }
   return tmpchar + 1;
 }
 
-char *makeConfPath (char *conf, const char *rawname)
-{
+char *makeConfPath (const char *conf, const char *rawname)
+{ /* return path of config-file, which must be freed later.
+   * return NULL if memory cannot be allocated. */
   char *ret;
   struct stat buf;
-  removeLastSlash (conf);
 
   if (!conf)
   { /* conf is not specified */
     ret = malloc ((strlen (rawname) + 6) * sizeof (char)); /* rawname + ".conf\0" */
-    sprintf (ret, "%s.conf", rawname);
-    return ret;
+    if (ret)
+      sprintf (ret, "%s.conf", rawname);
   }
-  if ((stat (conf, &buf) == 0) && S_ISDIR (buf.st_mode))
+  else if ((stat (conf, &buf) == 0) && S_ISDIR (buf.st_mode))
   { /* conf is exist and directory */
     ret = malloc ((strlen (conf) + strlen (rawname) + 7) *sizeof (char));
-    sprintf (ret, "%s/%s.conf", conf, rawname);
-    return ret;
+    if (ret)
+      sprintf (ret, "%s/%s.conf", conf, rawname);
   }
-  return strdup (conf);
+  else
+    ret = strdup (conf);
+  if (!ret)
+    fprintf (stderr, "Cannot allocate memory for config-file of \"%s\".\n",
+             rawname);
+  return ret;
 }
 
 FILE *openConfStream (const char *conf)
-{
+{ /* return stream of conf, or print why not and return NULL. */
   FILE *ret;
   /* open conf stream */
   if (strcmp (conf, "-") == 0)
@@ -249,20 +1115,23 @@ FILE *openConfStream (const char *conf)
     ret = stdout;
   }
   else
-  {
+  { /* config-file which is a link to config-file of other Xcursor (alias)
+     * is replaced, so that the other one is not overwritten. */
+    struct stat buf;
+    if (lstat (conf, &buf) == 0 && S_ISLNK (buf.st_mode))
+      unlink (conf);
     ret = fopen (conf, "w");
     if (!ret)
     {
       int e = errno ;
       fprintf (stderr, "Cannot open \"%s\":%s\n", conf, strerror (e));
-      exit (1);
     }
   }
   return ret;
 }
 
-void dirIsWritable (const char *dir)
-{
+int checkDirectory (const char *dir)
+{ /* return 1 if dir is a writable directory, or print why not and return 0. */
   int e;
   struct stat buf;
 
@@ -271,20 +1140,27 @@ void dirIsWritable (const char *dir)
   {
     e = errno;
     fprintf (stderr, "%s:%s\n", dir, strerror(e));
-    exit (1);
+    return 0;
   }
   else if (!S_ISDIR (buf.st_mode))
   {
     fprintf (stderr, "%s is not a directory!\n", dir);
-    exit (1);
+    return 0;
   }
   /* Is output directory writable ? */
   if (faccessat (AT_FDCWD, dir, W_OK | X_OK,  AT_EACCESS) != 0)
   {
     e = errno;
     fprintf (stderr, "%s:%s\n", dir, strerror (e));
-    exit (1);
+    return 0;
   }
+  return 1;
+}
+
+void dirIsWritable (const char *dir)
+{
+  if (!checkDirectory (dir))
+    exit (1);
   return;
 }
 
@@ -302,15 +1178,16 @@ void removeLastSlash (char *str)
 
 char *
 getPrefixFromConfToOut (const char *conf, const char *out, const char *cwd)
-{ /* return path from conf to out. retruned path must be freed later */
+{ /* return path from conf to out. retruned path must be freed later.
+   * return NULL after printing why if it cannot be made. */
   char *ret;
   int conf_num;
   int out_num;
   if (conf[0] == '/' || conf[0] == '~' || out[0] == '/' || out[0] == '~')
   { /* abusolute path */
     ret = malloc ((strlen (out) + 2) * sizeof (char));
-    sprintf (ret, "%s/", out);
-    return ret;
+    if (ret)
+      sprintf (ret, "%s/", out);
   }
   else /* relative path */
   {
@@ -318,15 +1195,13 @@ getPrefixFromConfToOut (const char *conf, const char *out, const char *cwd)
     {
       if (strcmp (out, ".") == 0)
       {
-        ret = malloc (sizeof (char));
-        ret[0] = '\0';
-        return ret;
+        ret = strdup ("");
       }
       else
       {
         ret = malloc ((strlen (out) + 2) * sizeof (char));
-        sprintf (ret, "%s/", out);
-        return ret;
+        if (ret)
+          sprintf (ret, "%s/", out);
       }
     }
     else /* conf is not "-" */
@@ -335,20 +1210,22 @@ getPrefixFromConfToOut (const char *conf, const char *out, const char *cwd)
       dirNameS confDirArray[conf_num + 1];
       initializeDirName (confDirArray, conf_num + 1);
       appartDirName (confDirArray, conf_num, conf);
-      trimDirName (confDirArray);
 
       out_num = countSlashes (out);
       dirNameS outDirArray[out_num + 2];
       initializeDirName (outDirArray, out_num + 2);
       appartDirName (outDirArray, out_num + 1, out);
-      trimDirName (outDirArray);
+      if (!trimDirName (confDirArray) || !trimDirName (outDirArray))
+        return NULL;
 
       killCommonPart (confDirArray, outDirArray);
       reverseDirName (confDirArray, cwd);
       ret = writePathFromDirNames (confDirArray, outDirArray);
-      return ret;
     }
   }
+  if (!ret)
+    fprintf (stderr, "Cannot allocate memory for path to \"%s\".\n", out);
+  return ret;
 }
 
 int countSlashes (const char *string)
@@ -394,10 +1271,11 @@ void appartDirName (dirNameS retArray[], int max, const char *string)
   return;
 }
 
-void trimDirName (dirNameS Array[])
+int trimDirName (dirNameS Array[])
 {
   /* if DOWN is followed by UP, the two Elements are DEAD. */
-  /* Make sure Array.state must be NON terminated. */
+  /* Make sure Array.state must be NON terminated.
+   * return 0 if Array is broken, 1 otherwise. */
   int i, j;
   int downs_count = 0;
   for (i = 0; Array[i].state; ++i)
@@ -412,20 +1290,20 @@ void trimDirName (dirNameS Array[])
       Array[i].state = DEAD;
       for (j = i; ; --j)
       {
+        if (j < 0)
+        {
+          fprintf (stderr, "Error occur in function \"trimDirName\"!\n");
+          return 0;
+        }
         if (Array[j].state == DOWN)
         {
           Array[j].state = DEAD;
           break;
         }
-        if (j < 0)
-        {
-          fprintf (stderr, "Error occur in function \"trimDirName\"!");
-          exit (1);
-        }
       }
     }
   }
-  return;
+  return 1;
 }
 
 void killCommonPart (dirNameS a[], dirNameS b[])
@@ -494,20 +1372,14 @@ void reverseDirName (dirNameS array[], const char *cwd)
 }
 
 void setStateOfDirNameS (dirNameS* dirsp)
-{
-  if (dirsp->length == 1)
+{ /* names of one or two characters other than "." and ".." are DOWN too. */
+  if (dirsp->length == 1 && dirsp->dirp[0] == '.')
   {
-    if (dirsp->dirp[0] == '.')
-    {
-      dirsp->state = DEAD;
-    }
+    dirsp->state = DEAD;
   }
-  else if (dirsp->length == 2)
+  else if (dirsp->length == 2 && strncmp (dirsp->dirp, "..", 2) == 0)
   {
-    if (strncmp (dirsp->dirp, "..", 2) == 0)
-    {
-      dirsp->state = UP;
-    }
+    dirsp->state = UP;
   }
   else
   {
@@ -529,85 +1401,776 @@ void printProgress (int num, int total)
   return;
 }
 
-int writePngFileFromXcur (const XcursorDim width, const XcursorDim height,
-                          const XcursorPixel* pixels, const char* pngName)
-{
-  FILE *fp = fopen(pngName, "wb");
+int writeFileFromBuffer (const char *name, const unsigned char *data,
+                         size_t length)
+{ /* write data to file, or add it to archive if --archive is given.
+   * return 1 if success, -1 if fail. */
+  extern archiveS archive;
+  extern char *store_dir;
+  FILE *fp;
+  if (archive.format != ARCHIVE_NONE)
+    return addArchiveEntry (name, data, length) ? 1 : -1;
+  if (store_dir)
+    return writeStoreObject (name, data, length);
+  fp = fopen(name, "wb");
   if (!fp)
   {
-    fprintf(stderr, "\nCannot write \"%s\".\n", pngName);
+    fprintf(stderr, "\nCannot write \"%s\".\n", name);
     return -1;
   }
-
-  png_voidp user_error_ptr=NULL;
-  png_error_ptr user_error_fn=NULL, user_warning_fn=NULL;
-  png_structp png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, user_error_ptr, user_error_fn, user_warning_fn);
-  if (!png_ptr)
+  if (fwrite (data, 1, length, fp) != length)
   {
-    fclose (fp);
+    fprintf(stderr, "\nCannot write \"%s\".\n", name);
+    fclose(fp);
     return -1;
   }
-
-  png_infop info_ptr = png_create_info_struct(png_ptr);
-  if (!info_ptr)
+  if (fclose(fp) != 0)
   {
-     fclose (fp);
-     png_destroy_write_struct(&png_ptr, (png_infopp)NULL);
-     return -1;
+    fprintf(stderr, "\nCannot write \"%s\".\n", name);
+    return -1;
   }
+  return 1;
+}
 
-  png_init_io(png_ptr, fp);
-
-  png_set_IHDR(png_ptr, info_ptr, width, height, 8, PNG_COLOR_TYPE_RGB_ALPHA,
-                PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE);
-
-  //Write file info.
-  png_write_info(png_ptr, info_ptr);
-
-  //convert BGRA -> RGBA
-  png_set_bgr(png_ptr);
-
-  //Get back non-premuliplied RGB value by alpha fraction.
-  //We cannot get original RGB value because xcursorgen multiply 
-  //PNG's R by alpha to get Xcursor's R. (Same applies to G and B.)
-  //This becomes more of a problem if alpha is too small. 
-  //But the error will be reduced enough when you regenerate Xcursor
-  //from PNGs with xcursorgen.
-  int i;
-  XcursorPixel pix[width * height];
-  for (i=0; i < width * height; i++)
+int writeStoreObject (const char *name, const unsigned char *data,
+                      size_t length)
+{ /* write data to a temporary file and rename it to name, so that object
+   * of --store is never seen half written, even if another process or
+   * job writes the same object at once. return 1 if success, -1 if fail. */
+  extern mode_t store_umask;
+  char *tmp = malloc (strlen (name) + 8);
+  int fd;
+  int ok;
+  if (!tmp)
   {
-    unsigned int alpha = pixels[i]>>24;
-    if (alpha == 0)
-    {
-      pix[i] = pixels[i];
+    fprintf (stderr, "\nCannot allocate memory for \"%s\".\n", name);
+    return -1;
+  }
+  sprintf (tmp, "%s.XXXXXX", name);
+  fd = mkstemp (tmp);
+  if (fd == -1)
+  {
+    fprintf (stderr, "\nCannot write \"%s\".\n", name);
+    free (tmp);
+    return -1;
+  }
+  /* mkstemp(3) creates file only readable by owner. */
+  ok = fchmod (fd, 0666 & ~store_umask) == 0;
+  while (ok && length > 0)
+  {
+    ssize_t n = write (fd, data, length);
+    if (n == -1 && errno == EINTR)
       continue;
+    ok = (n > 0);
+    if (ok)
+    {
+      data += n;
+      length -= n;
     }
-    unsigned int red = (pixels[i]>>16) & 0xff;
-    unsigned int green = (pixels[i]>>8) & 0xff;
-    unsigned int blue = pixels[i] & 0xff;
-    red = (div (red * 256, alpha).quot) & 0xff;
-    green = (div (green * 256,  alpha).quot) & 0xff;
-    blue = (div (blue * 256, alpha).quot) & 0xff;
-    pix[i] = (alpha << 24) + (red << 16) + (green << 8) + blue;
   }
-
-  png_byte *row_pointers[height];
-  for (i = 0; i < height ;i++)
+  if (close (fd) != 0)
+    ok = 0;
+  if (!ok || rename (tmp, name) != 0)
   {
-    row_pointers[i] = (png_byte *) (pix + width*i);
+    fprintf (stderr, "\nCannot write \"%s\".\n", name);
+    unlink (tmp);
+    free (tmp);
+    return -1;
   }
+  free (tmp);
+  return 1;
+}
 
-  //Write the image data.
-  png_write_image(png_ptr, row_pointers);
-
-  png_write_end(png_ptr, NULL);
+const char *archiveName (const char *name)
+{ /* return name of entry in archive. "./" and "/" at the beginning of
+   * name are removed as tar(1) does. */
+  for (;;)
+  {
+    if (name[0] == '/')
+      ++name;
+    else if (name[0] == '.' && name[1] == '/')
+      name += 2;
+    else
+      return name;
+  }
+}
 
-  png_destroy_write_struct(&png_ptr, &info_ptr);
-  fclose(fp);
+int writeArchive (const void *data, size_t length)
+{ /* write data to archive. archive.lock must be held.
+   * return 1 if success, 0 if fail. */
+  extern archiveS archive;
+  if (archive.failed || fwrite (data, 1, length, archive.fp) != length)
+  {
+    archive.failed = 1;
+    return 0;
+  }
+  archive.offset += length;
   return 1;
 }
 
+int addTarEntry (const char *name, const unsigned char *data, size_t length,
+                 int link)
+{ /* write ustar header and data padded to 512 bytes. If link is 1, data is
+   * target of symbolic link and written in header instead.
+   * return 1 if success, 0 if fail. */
+  extern archiveS archive;
+  unsigned char header[512];
+  size_t len = strlen (name);
+  const char *split = NULL;   /* name is split into prefix and name here. */
+  unsigned int sum = 0;
+  int i;
+
+  memset (header, 0, sizeof (header));
+  if (len > 100)
+  { /* long name is split at a slash into prefix and name. */
+    split = strchr (name + len - 101, '/');
+    if (!split || split - name > 155 || split == name)
+    {
+      fprintf (stderr, "\n\"%s\" is too long for tar!\n", name);
+      return 0;
+    }
+    memcpy (header + 345, name, split - name);
+    name = split + 1;
+  }
+  if (link && length > 100)
+  {
+    fprintf (stderr, "\nTarget of \"%s\" is too long for tar!\n", name);
+    return 0;
+  }
+  memcpy (header, name, strlen (name));
+  sprintf ((char *) header + 100, "%07o", link ? 0777 : 0644);
+  sprintf ((char *) header + 108, "%07o", 0);
+  sprintf ((char *) header + 116, "%07o", 0);
+  sprintf ((char *) header + 124, "%011lo", link ? 0UL : (unsigned long) length);
+  sprintf ((char *) header + 136, "%011lo", (unsigned long) archive.mtime);
+  header[156] = link ? '2' : '0';
+  if (link)
+  { /* symbolic link has no data. */
+    memcpy (header + 157, data, length);
+    length = 0;
+  }
+  memcpy (header + 257, "ustar", 6);
+  memcpy (header + 263, "00", 2);
+  /* checksum is calculated with checksum field filled with spaces. */
+  memset (header + 148, ' ', 8);
+  for (i = 0; i < sizeof (header); ++i)
+    sum += header[i];
+  sprintf ((char *) header + 148, "%06o", sum);
+
+  if (!writeArchive (header, sizeof (header)) ||
+      !writeArchive (data, length))
+    return 0;
+  memset (header, 0, sizeof (header));
+  if (length % 512 && !writeArchive (header, 512 - length % 512))
+    return 0;
+  return 1;
+}
+
+int addZipEntry (const char *name, const unsigned char *data, size_t length,
+                 int link)
+{ /* write local file header and data without compression, because PNG
+   * is already compressed. If link is 1, data is target of symbolic link,
+   * which is stored as data as Info-ZIP does. return 1 if success, 0 if fail. */
+  extern archiveS archive;
+  unsigned char header[30];
+  unsigned int dosTime, dosDate;
+  size_t len = strlen (name);
+  zipEntry *entry;
+
+  if (archive.nentry >= 0xffff || len > 0xffff || length > 0xffffffffUL ||
+      archive.offset + 30 + len + length > 0xffffffffUL)
+  { /* ZIP64 is not supported. */
+    fprintf (stderr, "\nToo many or too large files for zip!\n");
+    return 0;
+  }
+  if (archive.nentry == archive.maxEntry)
+  { /* entries are kept as they are if realloc fails. */
+    int max = archive.maxEntry ? archive.maxEntry * 2 : 64;
+    zipEntry *entries = realloc (archive.entries, max * sizeof (zipEntry));
+    if (!entries)
+    {
+      fprintf (stderr, "\nCannot allocate memory for zip entry \"%s\".\n",
+               name);
+      return 0;
+    }
+    archive.entries = entries;
+    archive.maxEntry = max;
+  }
+  entry = archive.entries + archive.nentry;
+  entry->name = strdup (name);
+  if (!entry->name)
+  {
+    fprintf (stderr, "\nCannot allocate memory for zip entry \"%s\".\n",
+             name);
+    return 0;
+  }
+  ++archive.nentry;
+  entry->crc = crc32 (crc32 (0L, Z_NULL, 0), data, length);
+  entry->size = length;
+  entry->offset = archive.offset;
+  entry->mode = link ? 0120777 : 0100644;
+
+  dosDateTime (archive.mtime, &dosDate, &dosTime);
+  putUInt32LE (header, 0x04034b50);
+  putUInt16LE (header + 4, 10);         /* version needed is 1.0. */
+  putUInt16LE (header + 6, 0);          /* no flags. */
+  putUInt16LE (header + 8, 0);          /* stored. */
+  putUInt16LE (header + 10, dosTime);
+  putUInt16LE (header + 12, dosDate);
+  putUInt32LE (header + 14, entry->crc);
+  putUInt32LE (header + 18, entry->size);
+  putUInt32LE (header + 22, entry->size);
+  putUInt16LE (header + 26, len);
+  putUInt16LE (header + 28, 0);         /* no extra field. */
+  return writeArchive (header, sizeof (header)) &&
+         writeArchive (name, len) && writeArchive (data, length);
+}
+
+void putUInt16LE (unsigned char *p, unsigned int value)
+{ /* zip is always little endian. */
+  p[0] = value;
+  p[1] = value >> 8;
+  return;
+}
+
+void dosDateTime (time_t t, unsigned int *datep, unsigned int *timep)
+{ /* convert t to date and time of MS-DOS which zip uses. */
+  struct tm tm;
+  localtime_r (&t, &tm);
+  *timep = (tm.tm_hour << 11) | (tm.tm_min << 5) | (tm.tm_sec / 2);
+  *datep = ((tm.tm_year - 80) << 9) | ((tm.tm_mon + 1) << 5) | tm.tm_mday;
+  return;
+}
+
+int addArchiveEntry (const char *name, const unsigned char *data,
+                     size_t length)
+{ /* add a file to archive. Entries are written in order they are added,
+   * so archive can be streamed to a pipe. return 1 if success, 0 if fail. */
+  extern archiveS archive;
+  int ret;
+  name = archiveName (name);
+  pthread_mutex_lock (&archive.lock);
+  if (archive.format == ARCHIVE_TAR)
+    ret = addTarEntry (name, data, length, 0);
+  else
+    ret = addZipEntry (name, data, length, 0);
+  pthread_mutex_unlock (&archive.lock);
+  if (!ret && archive.failed)
+    fprintf (stderr, "\nCannot write archive.\n");
+  return ret;
+}
+
+int addArchiveLink (const char *name, const char *target)
+{ /* add a symbolic link to archive. return 1 if success, 0 if fail. */
+  extern archiveS archive;
+  int ret;
+  name = archiveName (name);
+  pthread_mutex_lock (&archive.lock);
+  if (archive.format == ARCHIVE_TAR)
+    ret = addTarEntry (name, (const unsigned char *) target, strlen (target), 1);
+  else
+    ret = addZipEntry (name, (const unsigned char *) target, strlen (target), 1);
+  pthread_mutex_unlock (&archive.lock);
+  if (!ret && archive.failed)
+    fprintf (stderr, "\nCannot write archive.\n");
+  return ret;
+}
+
+int writeSymlink (const char *name, const char *target)
+{ /* make symbolic link name to target, or add it to archive if --archive
+   * is given. File at name is replaced. return 1 if success, -1 if fail. */
+  extern archiveS archive;
+  if (archive.format != ARCHIVE_NONE)
+    return addArchiveLink (name, target) ? 1 : -1;
+  if ((unlink (name) != 0 && errno != ENOENT) || symlink (target, name) != 0)
+  {
+    int e = errno;
+    fprintf (stderr, "\nCannot write \"%s\":%s\n", name, strerror (e));
+    return -1;
+  }
+  return 1;
+}
+
+void startWriter (int nthreads)
+{ /* start nthreads threads which write files queued by queueFile.
+   * If no thread can be started, files are written synchronously. */
+  extern writerS writer;
+  extern int write_threads;
+  int i;
+  writer.threads = malloc ((nthreads ? nthreads : 1) * sizeof (pthread_t));
+  if (!writer.threads)
+  { /* as if --write-threads 0 were given. */
+    write_threads = 0;
+    writer.nthreads = 0;
+    return;
+  }
+  for (i = 0; i < nthreads; ++i)
+  {
+    if (pthread_create (writer.threads + i, NULL, writerThread, NULL) != 0)
+      break;
+  }
+  writer.nthreads = i;
+  return;
+}
+
+void stopWriter (void)
+{ /* wait until all queued files are written and stop threads. */
+  extern writerS writer;
+  int i;
+  pthread_mutex_lock (&writer.lock);
+  writer.stopped = 1;
+  pthread_cond_broadcast (&writer.queued);
+  pthread_mutex_unlock (&writer.lock);
+  for (i = 0; i < writer.nthreads; ++i)
+  {
+    pthread_join (writer.threads[i], NULL);
+  }
+  free (writer.threads);
+  writer.threads = NULL;
+  writer.nthreads = 0;
+  return;
+}
+
+void *writerThread (void *arg)
+{ /* write queued files one by one until writer is stopped. */
+  extern writerS writer;
+  writeRequest *r;
+  int ret;
+  for (;;)
+  {
+    pthread_mutex_lock (&writer.lock);
+    while (!writer.head && !writer.stopped)
+      pthread_cond_wait (&writer.queued, &writer.lock);
+    r = writer.head;
+    if (r)
+    {
+      writer.head = r->next;
+      if (!writer.head)
+        writer.tail = NULL;
+    }
+    pthread_mutex_unlock (&writer.lock);
+    if (!r)
+      break;
+    ret = writeFileFromBuffer (r->name, r->data, r->length);
+    pthread_mutex_lock (&writer.lock);
+    writer.bytes -= r->length;
+    if (ret == -1)
+      r->group->failed = 1;
+    --r->group->pending;
+    pthread_cond_broadcast (&writer.written);
+    pthread_mutex_unlock (&writer.lock);
+    free (r->name);
+    free (r->data);
+    free (r);
+  }
+  return NULL;
+}
+
+int queueFile (writeGroup *group, const char *name, const unsigned char *data,
+               size_t length)
+{ /* queue data to be written to file by writer thread, so that caller can
+   * encode next image while it is written. data is copied, so caller can
+   * reuse it at once. If WRITE_QUEUE_MAX bytes are already queued, wait
+   * for them to be written first, so memory in flight is bounded.
+   * If writer is not started, data is written at once.
+   * return 1 if success, -1 if fail. */
+  extern writerS writer;
+  writeRequest *r;
+  if (writer.nthreads == 0 || !group)
+    return writeFileFromBuffer (name, data, length);
+  r = malloc (sizeof (writeRequest));
+  if (r)
+  {
+    r->name = strdup (name);
+    r->data = malloc (length ? length : 1);
+  }
+  if (!r || !r->name || !r->data)
+  { /* write it at once without copy. */
+    if (r)
+    {
+      free (r->name);
+      free (r->data);
+    }
+    free (r);
+    return writeFileFromBuffer (name, data, length);
+  }
+  memcpy (r->data, data, length);
+  r->length = length;
+  r->group = group;
+  r->next = NULL;
+  pthread_mutex_lock (&writer.lock);
+  while (writer.bytes > 0 && writer.bytes + length > WRITE_QUEUE_MAX)
+    pthread_cond_wait (&writer.written, &writer.lock);
+  writer.bytes += length;
+  ++group->pending;
+  if (writer.tail)
+    writer.tail->next = r;
+  else
+    writer.head = r;
+  writer.tail = r;
+  pthread_cond_signal (&writer.queued);
+  pthread_mutex_unlock (&writer.lock);
+  return 1;
+}
+
+int waitWrites (writeGroup *group)
+{ /* wait until all files of group are written.
+   * return 1 if all of them are written, 0 if any of them failed. */
+  extern writerS writer;
+  int ret;
+  pthread_mutex_lock (&writer.lock);
+  while (group->pending > 0)
+    pthread_cond_wait (&writer.written, &writer.lock);
+  ret = !group->failed;
+  pthread_mutex_unlock (&writer.lock);
+  return ret;
+}
+
+int finishArchive (void)
+{ /* write end of archive and close it. return 1 if success, 0 if fail. */
+  extern archiveS archive;
+  unsigned char buf[1024];
+  unsigned long start = archive.offset;
+  int i;
+
+  memset (buf, 0, sizeof (buf));
+  if (archive.format == ARCHIVE_TAR)
+  { /* two zero blocks mark end of tar. */
+    writeArchive (buf, 1024);
+  }
+  else
+  { /* central directory and end of central directory record. */
+    unsigned int dosTime, dosDate;
+    dosDateTime (archive.mtime, &dosDate, &dosTime);
+    for (i = 0; i < archive.nentry; ++i)
+    {
+      const zipEntry *entry = archive.entries + i;
+      size_t len = strlen (entry->name);
+      memset (buf, 0, 46);
+      putUInt32LE (buf, 0x02014b50);
+      putUInt16LE (buf + 4, 3 << 8 | 20);   /* made by unix, version 2.0. */
+      putUInt16LE (buf + 6, 10);            /* version needed is 1.0. */
+      putUInt16LE (buf + 12, dosTime);
+      putUInt16LE (buf + 14, dosDate);
+      putUInt32LE (buf + 16, entry->crc);
+      putUInt32LE (buf + 20, entry->size);
+      putUInt32LE (buf + 24, entry->size);
+      putUInt16LE (buf + 28, len);
+      putUInt32LE (buf + 38, entry->mode << 16); /* mode of file. */
+      putUInt32LE (buf + 42, entry->offset);
+      writeArchive (buf, 46);
+      writeArchive (entry->name, len);
+      free (entry->name);
+    }
+    memset (buf, 0, 22);
+    putUInt32LE (buf, 0x06054b50);
+    putUInt16LE (buf + 8, archive.nentry);
+    putUInt16LE (buf + 10, archive.nentry);
+    putUInt32LE (buf + 12, archive.offset - start);
+    putUInt32LE (buf + 16, start);
+    writeArchive (buf, 22);
+    free (archive.entries);
+  }
+  if (archive.fp == stdout)
+  {
+    if (fflush (archive.fp) != 0)
+      archive.failed = 1;
+  }
+  else if (fclose (archive.fp) != 0)
+    archive.failed = 1;
+  if (archive.failed)
+    fprintf (stderr, "Cannot write archive.\n");
+  return !archive.failed;
+}
+
+int writePngFileFromXcur (convContext *ctx, const XcursorDim width,
+                          const XcursorDim height, const unsigned char* pixels,
+                          const char* pngName, frameStats *stats,
+                          writeGroup *writes)
+{
+  double start = 0, converted = 0, encoded = 0;
+  extern xcur2pngOptions conv_options;
+  if (stats)
+    start = now ();
+  if (!reserveConvContext (ctx, width, height))
+  {
+    fprintf(stderr, "\nCannot allocate memory for \"%s\".\n", pngName);
+    return -1;
+  }
+
+  //Get back non-premuliplied RGB value by alpha fraction.
+  //We cannot get original RGB value because xcursorgen multiply 
+  //PNG's R by alpha to get Xcursor's R. (Same applies to G and B.)
+  //This becomes more of a problem if alpha is too small. 
+  //But the error will be reduced enough when you regenerate Xcursor
+  //from PNGs with xcursorgen.
+  unpremultiplyPixels (ctx->pix, pixels, width * height);
+  if (stats)
+    converted = now ();
+
+  if (encodeImage (ctx, ctx->pix, width, height, (size_t) width * 4,
+                   &conv_options) == -1)
+    return -1;
+  if (stats)
+    encoded = now ();
+
+  if (queueFile (writes, pngName, ctx->png, ctx->pngLen) == -1)
+    return -1;
+  if (stats)
+  {
+    stats->width = width;
+    stats->height = height;
+    stats->convert = converted - start;
+    stats->encode = encoded - converted;
+    stats->write = now () - encoded;
+    stats->bytes = ctx->pngLen;
+    addRoundTripError (stats, pixels, (size_t) width * height);
+  }
+  return 1;
+}
+
+int writeAtlasFromXcur (convContext *ctx, const xcurFile *xf,
+                        const int *members, int n, const atlasLayout *layout,
+                        const char *pngName, frameStats *stats,
+                        writeGroup *writes)
+{ /* write n images listed in members to an atlas PNG.
+   * Each image is placed at top-left corner of its cell. */
+  xcurImage image;
+  XcursorDim width = layout->columns * layout->cellWidth;
+  XcursorDim height = ((n + layout->columns - 1) / layout->columns)
+                      * layout->cellHeight;
+  double start = 0, converted = 0, encoded = 0;
+  int i, y;
+  extern xcur2pngOptions conv_options;
+
+  if (stats)
+    start = now ();
+  if (!reserveConvContext (ctx, width, height))
+  {
+    fprintf(stderr, "\nCannot allocate memory for \"%s\".\n", pngName);
+    return -1;
+  }
+  /* Cells which are not covered by images are transparent. */
+  memset (ctx->pix, 0, (size_t) width * height * 4);
+  for (i = 0; i < n; ++i)
+  {
+    unsigned char *cell = ctx->pix
+      + ((size_t) (i / layout->columns) * layout->cellHeight * width
+         + (size_t) (i % layout->columns) * layout->cellWidth) * 4;
+    getXcursorImage (xf, members[i], &image);
+    for (y = 0; y < image.height; ++y)
+    {
+      unpremultiplyPixels (cell + (size_t) y * width * 4,
+                           image.pixels + (size_t) y * image.width * 4,
+                           image.width);
+    }
+    releaseXcursorImage (xf, &image);
+  }
+  if (stats)
+    converted = now ();
+
+  if (encodeImage (ctx, ctx->pix, width, height, (size_t) width * 4,
+                   &conv_options) == -1)
+    return -1;
+  if (stats)
+    encoded = now ();
+
+  if (queueFile (writes, pngName, ctx->png, ctx->pngLen) == -1)
+    return -1;
+  if (stats)
+  {
+    stats->width = width;
+    stats->height = height;
+    stats->convert = converted - start;
+    stats->encode = encoded - converted;
+    stats->write = now () - encoded;
+    stats->bytes = ctx->pngLen;
+    addGroupError (stats, xf, members, n);
+  }
+  return 1;
+}
+
+int openXcursorFile (xcurFile *xf, const char *path)
+{ /* map Xcursor file at path to memory and parse it.
+   * return 1 if success, 0 if fail. */
+  int fd;
+  struct stat buf;
+  void *map;
+  extern xcur2pngOptions conv_options;
+
+  xf->mapped = 0;
+  fd = open (path, O_RDONLY);
+  if (fd < 0)
+    return 0;
+  if (fstat (fd, &buf) != 0 || !S_ISREG (buf.st_mode) || buf.st_size < 16)
+  {
+    close (fd);
+    return 0;
+  }
+  map = mmap (NULL, buf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close (fd);
+  if (map == MAP_FAILED)
+    return 0;
+  xf->mapped = 1;
+  if (!parseXcursor (xf, map, buf.st_size, &conv_options))
+  {
+    munmap (map, buf.st_size);
+    xf->mapped = 0;
+    return 0;
+  }
+  return 1;
+}
+
+void closeXcursorFile (xcurFile *xf)
+{
+  if (xf->mapped)
+    munmap ((void *) xf->data, xf->length);
+  freeXcursor (xf);
+  return;
+}
+
+void initRoundTripError (void)
+{ /* round trip every value with each alpha through the same functions
+   * as conversion and --reverse, so that table follows changes of them. */
+  unsigned char src[256 * 4], rgba[256 * 4];
+  unsigned int alpha, value;
+  int e;
+  for (alpha = 0; alpha < 256; ++alpha)
+  {
+    for (value = 0; value < 256; ++value)
+    {
+      src[value * 4] = src[value * 4 + 1] = src[value * 4 + 2] = value;
+      src[value * 4 + 3] = alpha;
+    }
+    unpremultiplyPixels (rgba, src, 256);
+    /* --reverse premultiplies BGRA, but gray pixels are the same. */
+    premultiplyPixels (rgba, 256);
+    for (value = 0; value < 256; ++value)
+    {
+      e = (int) rgba[value * 4] - (int) value;
+      roundTripError[alpha][value] = (e < 0) ? -e : e;
+    }
+  }
+  return;
+}
+
+void addRoundTripError (frameStats *stats, const unsigned char *pixels,
+                        size_t n)
+{ /* add errors of n premultiplied ARGB pixels of Xcursor to stats. */
+  size_t i;
+  int c;
+  pthread_once (&roundTripOnce, initRoundTripError);
+  for (i = 0; i < n; i++, pixels += 4)
+  {
+    const unsigned char *t = roundTripError[pixels[3]];
+    for (c = 0; c < 3; ++c)
+    {
+      if (t[pixels[c]] > stats->maxError)
+        stats->maxError = t[pixels[c]];
+      stats->errorSum += t[pixels[c]];
+    }
+  }
+  stats->channels += n * 3;
+  return;
+}
+
+void addGroupError (frameStats *stats, const xcurFile *xf, const int *members,
+                    int n)
+{ /* add errors of n images listed in members to stats of their atlas or
+   * APNG. */
+  xcurImage image;
+  int i;
+  for (i = 0; i < n; ++i)
+  {
+    getXcursorImage (xf, members[i], &image);
+    addRoundTripError (stats, image.pixels,
+                       (size_t) image.width * image.height);
+    releaseXcursorImage (xf, &image);
+  }
+  return;
+}
+
+double now (void)
+{ /* return monotonic time in seconds. */
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void printJsonString (FILE *fp, const char *str)
+{
+  fputc ('"', fp);
+  for (; *str; ++str)
+  {
+    if (*str == '"' || *str == '\\')
+      fprintf (fp, "\\%c", *str);
+    else if ((unsigned char) *str < 0x20)
+      fprintf (fp, "\\u%04x", (unsigned char) *str);
+    else
+      fputc (*str, fp);
+  }
+  fputc ('"', fp);
+  return;
+}
+
+void printStats (const char *cursor, int ok, const cursorStats *stats,
+                 int allocations)
+{ /* write statistics of a Xcursor as a line of JSON object. */
+  extern FILE *stats_strm;
+  extern pthread_mutex_t stats_lock;
+  struct rusage usage;
+  double convert = 0, encode = 0, write = 0;
+  size_t bytesWritten = 0;
+  int maxError = 0;
+  uint64_t errorSum = 0, channels = 0;
+  int nframe = stats->frames ? stats->npng : 0;
+  int i;
+
+  for (i = 0; i < nframe; ++i)
+  {
+    convert += stats->frames[i].convert;
+    encode += stats->frames[i].encode;
+    write += stats->frames[i].write;
+    bytesWritten += stats->frames[i].bytes;
+    if (stats->frames[i].maxError > maxError)
+      maxError = stats->frames[i].maxError;
+    errorSum += stats->frames[i].errorSum;
+    channels += stats->frames[i].channels;
+  }
+  getrusage (RUSAGE_SELF, &usage);
+
+  pthread_mutex_lock (&stats_lock);
+  fprintf (stats_strm, "{\"cursor\": ");
+  printJsonString (stats_strm, cursor);
+  fprintf (stats_strm, ", \"ok\": %s, \"images\": %d, \"pngs\": %d, "
+           "\"files_created\": %d, \"bytes_read\": %lu, "
+           "\"bytes_written\": %lu, \"buffer_allocations\": %d, "
+           "\"peak_rss_kb\": %ld, ",
+           ok ? "true" : "false", stats->nimage, stats->npng,
+           stats->filesCreated, (unsigned long) stats->bytesRead,
+           (unsigned long) bytesWritten, allocations, usage.ru_maxrss);
+  fprintf (stats_strm, "\"seconds\": {\"read\": %.6f, \"conf\": %.6f, "
+           "\"convert\": %.6f, \"encode\": %.6f, \"write\": %.6f, "
+           "\"total\": %.6f}, \"round_trip_error\": {\"max\": %d, "
+           "\"mean\": %.6f}, \"frames\": [",
+           stats->read, stats->conf, convert, encode, write, stats->total,
+           maxError, channels ? (double) errorSum / channels : 0.0);
+  for (i = 0; i < nframe; ++i)
+  {
+    const frameStats *f = stats->frames + i;
+    fprintf (stats_strm, "%s{\"image\": %d, \"width\": %u, \"height\": %u, "
+             "\"convert\": %.6f, \"encode\": %.6f, \"write\": %.6f, "
+             "\"bytes\": %lu, \"max_error\": %d, \"mean_error\": %.6f}",
+             i ? ", " : "", f->image, f->width, f->height, f->convert,
+             f->encode, f->write, (unsigned long) f->bytes, f->maxError,
+             f->channels ? (double) f->errorSum / f->channels : 0.0);
+  }
+  fprintf (stats_strm, "]}\n");
+  fflush (stats_strm);
+  pthread_mutex_unlock (&stats_lock);
+  return;
+}
+
 void initializeDirName (dirNameS Array[], int len)
 {
   int i;
@@ -645,6 +2208,8 @@ char *writePathFromDirNames (dirNameS a[], dirNameS b[])
 { /* return path generated by a[] and b[] */
   char *ret = malloc (lengthOfDirName (a) + lengthOfDirName (b) + 1);
   char *p = ret;
+  if (!ret)
+    return NULL;
   writePathFromDirName (&p, a);
   writePathFromDirName (&p, b);
   *p = '\0';
@@ -664,104 +2229,2213 @@ int lengthOfDirName (dirNameS a[])
   return len;
 }
 
-int saveConfAndPNGs (const XcursorImages* xcIs, const char* xcurFilePart, int suffix,
-                     FILE* conffp, const char* imagePrefix, const char* outdir)
+int saveConfAndPNGs (const xcurFile* xf, const char* xcurFilePart, int suffix,
+                     FILE* conffp, const char* imagePrefix, const char* outdir,
+                     convContext *ctxs, int jobs, cursorStats *stats,
+                     const manifestEntry *old, manifestEntry *entry)
 {
-  int i;
+  int n;
   int ret;
   int count = 0;
   char pngName[PATH_MAX] = {0};
-  extern dry_run;
-  
+  frameArgs f;
+  xcur2pngEntry *entries;
+  int nentry = 0;
+  int *indices;       /* image written to each PNG. */
+  writeGroup writes = {0, 0};
+  extern int batch;
+  extern xcur2pngOptions conv_options;
+  extern int suffix_width;
+  extern char *store_dir;
+  double start = 0;
+
+  if (stats)
+    start = now ();
   //Write comment on config-file.
   fprintf (conffp,"#size\txhot\tyhot\tPath to PNG image\tdelay\n");
 
   /* print messages of progress */
-  VERBOSE_PRINT ("Converting cursor...\n");
-
-  for (i = suffix; count < xcIs->nimage; ++i, ++count)
+  if (!batch)
   {
-    //Read each images' properties.
+    VERBOSE_PRINT ("Converting cursor...\n");
+  }
 
-    XcursorUInt version = xcIs->images[count]->version;
-    XcursorDim size = xcIs->images[count]->size;
-    XcursorDim width = xcIs->images[count]->width;
-    XcursorDim height = xcIs->images[count]->height;
-    XcursorDim xhot = xcIs->images[count]->xhot;
-    XcursorDim yhot = xcIs->images[count]->yhot;
-    XcursorUInt delay = xcIs->images[count]->delay;
-    XcursorPixel *pixels = xcIs->images[count]->pixels;
+  /* Decide PNGs and config-file first, then PNGs are written in any order.
+   * With --store, identical images are the same object anyway, because
+   * objects are named by their pixels. */
+  ret = planXcursor (xf, conv_options.dedupe, &entries, &nentry, &indices,
+                     &count);
+  if (ret != XCUR2PNG_OK)
+  {
+    fprintf (stderr, "%s\n", xcur2pngStrerror (ret));
+    return 0;
+  }
+  if (count > 0 && suffix > INT_MAX - (count - 1))
+  {
+    fprintf(stderr,"Sorry, suffix is too large.\n");
+    free (entries);
+    free (indices);
+    return 0;
+  }
+  /* Check png image name to save. The last one is the longest. */
+  if (store_dir)
+    ret = snprintf (pngName, sizeof (pngName), "%s/%0*d.%s", outdir,
+                    IMAGE_DIGEST_LENGTH * 2, 0,
+                    xcur2pngExtension (conv_options.format));
+  else
+    ret = snprintf(pngName, sizeof(pngName), "%s/%s_%0*d.%s", outdir, xcurFilePart, suffix_width, suffix + (count ? count - 1 : 0), xcur2pngExtension (conv_options.format));
+  if (ret < 0 || ret >= sizeof (pngName))
+  {
+    fprintf(stderr, "Cannot set filename of output PNG!\n");
+    free (entries);
+    free (indices);
+    return 0;
+  }
 
-    if (version != 1)
+  /* Write config-file which can be reused by xcursorgen. With --store,
+   * it is written after PNGs because names of them are digests of pixels. */
+  for (n = 0; n < nentry && !store_dir; ++n)
+  {
+    fprintf (conffp,"%d\t%d\t%d\t%s%s_%0*d.%s\t%d\n", entries[n].size, entries[n].xhot, entries[n].yhot, imagePrefix, xcurFilePart, suffix_width, suffix + entries[n].png, xcur2pngExtension (conv_options.format), entries[n].delay);
+  }
+  if (stats)
+  {
+    stats->conf = now () - start;
+    stats->npng = count;
+    /* without memory, only statistics of whole Xcursor are reported. */
+    stats->frames = calloc (count ? count : 1, sizeof (frameStats));
+    for (n = 0; stats->frames && n < count; ++n)
+      stats->frames[n].image = indices[n];
+  }
+  if (entry)
+  { /* names and hashes of PNGs are set by saveFrameJob. */
+    entry->pngs = calloc (count ? count : 1, sizeof (manifestPng));
+    if (!entry->pngs)
     {
-      fprintf(stderr, "xcur2png can only retrieve Xcursor version 1.\n");
+      fprintf (stderr, "Cannot allocate memory for manifest!\n");
+      free (entries);
+      free (indices);
       return 0;
     }
+    entry->npng = count;
+  }
 
-    /* Set png image name to save. */
-    ret = snprintf(pngName, sizeof(pngName), "%s/%s_%03d.png", outdir, xcurFilePart, i);
-    if (ret < 0 || ret > sizeof (pngName))
+  //Save png files.
+  f.xf = xf;
+  f.indices = indices;
+  f.total = count;
+  f.xcurFilePart = xcurFilePart;
+  f.suffix = suffix;
+  f.outdir = outdir;
+  f.ctxs = ctxs;
+  f.stats = stats ? stats->frames : NULL;
+  f.old = old;
+  f.entry = entry;
+  f.writes = &writes;
+  f.failed = 0;
+  f.done = 0;
+  f.skipped = 0;
+  f.objects = NULL;
+  if (store_dir)
+  { /* without names, saveFrameJob would write PNGs named by suffix. */
+    f.objects = malloc ((count ? count : 1) * sizeof (*f.objects));
+    if (!f.objects)
     {
-      fprintf(stderr, "Cannot set filename of output PNG!\n");
+      fprintf (stderr, "Cannot allocate memory for names of objects!\n");
+      free (entries);
+      free (indices);
       return 0;
     }
+  }
+  pthread_mutex_init (&f.lock, NULL);
+  runJobs (count, jobs, saveFrameJob, &f);
+  pthread_mutex_destroy (&f.lock);
+  free (indices);
+  if (!waitWrites (&writes))
+    f.failed = 1;
+  if (f.failed)
+  { /* config-file of --store must not refer to objects not written. */
+    fprintf (stderr, "Error ocurred in function writePngFileFromXcur.\n");
+    free (entries);
+    free (f.objects);
+    return 0;
+  }
+  for (n = 0; n < nentry && store_dir; ++n)
+  {
+    fprintf (conffp, "%d\t%d\t%d\t%s%s.%s\t%d\n", entries[n].size,
+             entries[n].xhot, entries[n].yhot, imagePrefix,
+             f.objects[entries[n].png],
+             xcur2pngExtension (conv_options.format), entries[n].delay);
+  }
+  free (entries);
+  free (f.objects);
+  if (!batch)
+    fprintf (stderr, "\nConversion successfully done!(%d images were output.)\n", count);
+  if (!batch && f.skipped && store_dir)
+    VERBOSE_PRINT ("(%d of them were already in \"%s\".)\n", f.skipped,
+                   store_dir);
+  if (!batch && f.skipped && !store_dir)
+    VERBOSE_PRINT ("(%d of them were not changed and not written again.)\n",
+                   f.skipped);
+  return 1;
+}
+
+void saveFrameJob (int index, int worker, void *arg)
+{ /* write index-th PNG. */
+  frameArgs *f = arg;
+  xcurImage image;
+  char pngName[PATH_MAX];
+  int ret = 1;
+  int skip = 0;
+  struct stat buf;
+  extern int dry_run;
+  extern int batch;
+  extern int suffix_width;
+
+  if (f->objects)
+  { /* object named by SHA-256 of pixels is encoded and written only if it
+     * is not in store yet. Objects are never compared, because different
+     * pixels of the same digest are not expected to be found. */
+    unsigned char digest[IMAGE_DIGEST_LENGTH];
+    int i;
+    getXcursorImage (f->xf, f->indices[index], &image);
+    digestImage (&image, digest);
+    for (i = 0; i < IMAGE_DIGEST_LENGTH; ++i)
+      sprintf (f->objects[index] + i * 2, "%02x", digest[i]);
+    snprintf (pngName, sizeof (pngName), "%s/%s.%s", f->outdir,
+              f->objects[index], xcur2pngExtension (conv_options.format));
+    skip = dry_run || stat (pngName, &buf) == 0;
+    if (!skip)
+      ret = writePngFileFromXcur (f->ctxs + worker, image.width, image.height,
+                                  image.pixels, pngName,
+                                  f->stats ? f->stats + index : NULL,
+                                  f->writes);
+    releaseXcursorImage (f->xf, &image);
+  }
+  else if (!dry_run)
+  {
+    snprintf (pngName, sizeof (pngName), "%s/%s_%0*d.%s", f->outdir,
+              f->xcurFilePart, suffix_width, f->suffix + index,
+              xcur2pngExtension (conv_options.format));
+    getXcursorImage (f->xf, f->indices[index], &image);
+    if (f->entry)
+    { /* PNG of the same pixels as last conversion is left as it is. */
+      uint64_t hash = hashImage (&image);
+      f->entry->pngs[index].name = strdup (pngName);
+      f->entry->pngs[index].hash = hash;
+      skip = pngIsUnchanged (f->old, index, pngName, hash);
+      if (!f->entry->pngs[index].name)
+      { /* cursor fails, so that it is converted again next time. */
+        fprintf (stderr, "\nCannot allocate memory for manifest!\n");
+        ret = -1;
+      }
+    }
+    if (!skip && ret != -1)
+      ret = writePngFileFromXcur (f->ctxs + worker, image.width, image.height,
+                                  image.pixels, pngName,
+                                  f->stats ? f->stats + index : NULL,
+                                  f->writes);
+    releaseXcursorImage (f->xf, &image);
+  }
+  pthread_mutex_lock (&f->lock);
+  if (ret == -1)
+    f->failed = 1;
+  f->skipped += skip;
+  if (!batch)
+    printProgress (f->done, f->total);
+  ++f->done;
+  pthread_mutex_unlock (&f->lock);
+  return;
+}
 
-    /* Write config-file which can be reused by xcursorgen. */
-    fprintf (conffp,"%d\t%d\t%d\t%s%s_%03d.png\t%d\n", size, xhot, yhot, imagePrefix, xcurFilePart, i, delay);
-    
-    //Save png file.
-    if (dry_run)
-      {ret = 1;}
-    else
+
+void putUInt32BE (unsigned char *p, XcursorUInt value)
+{ /* PNG is always big endian. */
+  p[0] = value >> 24;
+  p[1] = value >> 16;
+  p[2] = value >> 8;
+  p[3] = value;
+  return;
+}
+
+int appendChunk (convContext *ctx, const char *type, long sequence,
+                 const unsigned char *data, size_t length)
+{ /* append a PNG chunk to ctx->apng. If sequence is not negative, it is
+   * prepended to data as sequence number of APNG. return 0 if fail. */
+  size_t dataLength = length + (sequence >= 0 ? 4 : 0);
+  unsigned char *p;
+  uLong crc;
+  if (!growBuffer (ctx, &ctx->apng, &ctx->apngSize,
+                   ctx->apngLen + dataLength + 12))
+    return 0;
+  p = ctx->apng + ctx->apngLen;
+  putUInt32BE (p, dataLength);
+  memcpy (p + 4, type, 4);
+  if (sequence >= 0)
+    putUInt32BE (p + 8, sequence);
+  if (length)
+    memcpy (p + 8 + (sequence >= 0 ? 4 : 0), data, length);
+  crc = crc32 (0L, p + 4, dataLength + 4);
+  putUInt32BE (p + 8 + dataLength, crc);
+  ctx->apngLen += dataLength + 12;
+  return 1;
+}
+
+void setFrameDelay (unsigned char *fcTL, XcursorUInt delay)
+{ /* set delay (in milliseconds) of fcTL chunk and update its CRC.
+   * delay_num and delay_den are 16 bits, so long delay loses precision. */
+  unsigned int num = delay, den = 1000;
+  if (num > 0xffff)
+  {
+    num = delay / 10;
+    den = 100;
+  }
+  if (num > 0xffff)
+  {
+    num = (delay / 1000 > 0xffff) ? 0xffff : delay / 1000;
+    den = 1;
+  }
+  fcTL[28] = num >> 8;
+  fcTL[29] = num;
+  fcTL[30] = den >> 8;
+  fcTL[31] = den;
+  putUInt32BE (fcTL + 34, crc32 (0L, fcTL + 4, 30));
+  return;
+}
+
+int writeApngFromXcur (convContext *ctx, const xcurFile *xf,
+                       const int *members, int n, const atlasLayout *layout,
+                       const char *pngName, frameStats *stats,
+                       writeGroup *writes)
+{ /* write n images listed in members to an APNG. Each frame after the
+   * first one only has the rectangle which differs from previous frame.
+   * Identical frames are merged and their delays are summed. */
+  static const unsigned char signature[8] =
+    {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+  XcursorDim width = layout->cellWidth;
+  XcursorDim height = layout->cellHeight;
+  size_t stride = (size_t) width * 4;
+  size_t actl = 0;          /* position of acTL chunk in ctx->apng. */
+  size_t fctl = 0;          /* position of last fcTL chunk. */
+  XcursorUInt delay = 0;    /* delay of last frame. */
+  XcursorUInt nframes = 0;
+  long sequence = 0;
+  unsigned char data[26];
+  xcurImage image;
+  double convert = 0, encode = 0, t;
+  int i, y;
+  extern xcur2pngOptions conv_options;
+  xcur2pngOptions options = conv_options;
+
+  /* all frames share IHDR of the first one, so they must be RGBA. */
+  options.keepRgba = 1;
+  if (!reserveConvContext (ctx, width, height) ||
+      !growBuffer (ctx, &ctx->prev, &ctx->prevSize, stride * height))
+  {
+    fprintf(stderr, "\nCannot allocate memory for \"%s\".\n", pngName);
+    return -1;
+  }
+  ctx->apngLen = 0;
+  if (!growBuffer (ctx, &ctx->apng, &ctx->apngSize, sizeof (signature)))
+    return -1;
+  memcpy (ctx->apng, signature, sizeof (signature));
+  ctx->apngLen = sizeof (signature);
+
+  for (i = 0; i < n; ++i)
+  {
+    XcursorDim x0 = 0, y0 = 0, x1 = width, y1 = height;
+    size_t p;
+    t = stats ? now () : 0;
+    /* draw frame on transparent canvas. */
+    memset (ctx->pix, 0, stride * height);
+    getXcursorImage (xf, members[i], &image);
+    for (y = 0; y < image.height; ++y)
     {
-      ret = writePngFileFromXcur (width, height, pixels, pngName);
+      unpremultiplyPixels (ctx->pix + y * stride,
+                           image.pixels + (size_t) y * image.width * 4,
+                           image.width);
     }
-    if (ret == -1)
+    releaseXcursorImage (xf, &image);
+    if (i > 0)
+    { /* find rectangle which differs from previous frame. */
+      x0 = width;
+      y0 = height;
+      x1 = y1 = 0;
+      for (y = 0; y < height; ++y)
+      {
+        const unsigned char *a = ctx->pix + y * stride;
+        const unsigned char *b = ctx->prev + y * stride;
+        XcursorDim l, r;
+        if (memcmp (a, b, stride) == 0)
+          continue;
+        for (l = 0; memcmp (a + l * 4, b + l * 4, 4) == 0; ++l)
+          {;}
+        for (r = width; memcmp (a + (r - 1) * 4, b + (r - 1) * 4, 4) == 0; --r)
+          {;}
+        if (l < x0)
+          x0 = l;
+        if (r > x1)
+          x1 = r;
+        if (y < y0)
+          y0 = y;
+        y1 = y + 1;
+      }
+      if (x1 == 0)
+      { /* same as previous frame. */
+        delay += image.delay;
+        setFrameDelay (ctx->apng + fctl, delay);
+        if (stats)
+          convert += now () - t;
+        continue;
+      }
+    }
+    memcpy (ctx->prev, ctx->pix, stride * height);
+    if (stats)
     {
-      fprintf (stderr, "Error ocurred in function writePngFileFromXcur.\n");
-      return 0;
+      convert += now () - t;
+      t = now ();
+    }
+
+    if (encodePng (ctx, ctx->pix + y0 * stride + x0 * 4, x1 - x0, y1 - y0,
+                   stride, &options) == -1)
+      return -1;
+    if (i == 0)
+    { /* IHDR of first frame is used for the APNG. */
+      if (!appendChunk (ctx, "IHDR", -1, ctx->png + 16, 13))
+        return -1;
+      actl = ctx->apngLen;
+      memset (data, 0, 8);  /* number of frames is set later. */
+      if (!appendChunk (ctx, "acTL", -1, data, 8))
+        return -1;
     }
-    if (i == 999)
+    fctl = ctx->apngLen;
+    delay = image.delay;
+    putUInt32BE (data + 4, x1 - x0);
+    putUInt32BE (data + 8, y1 - y0);
+    putUInt32BE (data + 12, x0);
+    putUInt32BE (data + 16, y0);
+    memset (data + 20, 0, 6);  /* delay is set below. dispose and blend
+                                  are NONE and SOURCE. */
+    if (!appendChunk (ctx, "fcTL", sequence++, data + 4, 22))
+      return -1;
+    setFrameDelay (ctx->apng + fctl, delay);
+    /* copy IDAT chunks of encoded PNG as IDAT (first frame) or fdAT. */
+    for (p = 8; p + 12 <= ctx->pngLen; )
     {
-      fprintf(stderr,"Sorry, xcur2png cannot count over 999.\n");
-      return 0;
+      XcursorUInt length = (ctx->png[p] << 24) | (ctx->png[p + 1] << 16)
+                           | (ctx->png[p + 2] << 8) | ctx->png[p + 3];
+      if (memcmp (ctx->png + p + 4, "IDAT", 4) == 0 &&
+          !appendChunk (ctx, i == 0 ? "IDAT" : "fdAT", i == 0 ? -1 : sequence++,
+                        ctx->png + p + 8, length))
+        return -1;
+      p += length + 12;
     }
+    ++nframes;
+    if (stats)
+      encode += now () - t;
+  }
+  /* set number of frames. number of plays is 0 (infinite). */
+  putUInt32BE (ctx->apng + actl + 8, nframes);
+  putUInt32BE (ctx->apng + actl + 16, crc32 (0L, ctx->apng + actl + 4, 12));
+  if (!appendChunk (ctx, "IEND", -1, NULL, 0))
+    return -1;
 
-    printProgress (i, xcIs->nimage);
+  t = stats ? now () : 0;
+  if (queueFile (writes, pngName, ctx->apng, ctx->apngLen) == -1)
+    return -1;
+  if (stats)
+  {
+    stats->width = width;
+    stats->height = height;
+    stats->convert = convert;
+    stats->encode = encode;
+    stats->write = now () - t;
+    stats->bytes = ctx->apngLen;
+    addGroupError (stats, xf, members, n);
   }
-  fprintf (stderr, "\nConversion successfully done!(%d images were output.)\n", count);
   return 1;
 }
 
+int groupBySize (const xcurFile *xf, int *members, int *starts)
+{ /* sort images by nominal size, keeping order of first appearance of each
+   * size and order of images in each size. return the number of sizes,
+   * or -1 if memory cannot be allocated.
+   * members must have xf->nimage elements, starts must have
+   * xf->nimage + 1 elements. */
+  xcurImage image;
+  XcursorDim *sizes = malloc ((xf->nimage ? xf->nimage : 1) * sizeof (XcursorDim));
+  int *group = malloc ((xf->nimage ? xf->nimage : 1) * sizeof (int));
+  int ngroup = 0;
+  int i, g;
 
-int main (int argc, char *argv[])
-{
+  if (!sizes || !group)
+  {
+    free (sizes);
+    free (group);
+    return -1;
+  }
+
+  for (i = 0; i < xf->nimage; ++i)
+  {
+    getXcursorImage (xf, i, &image);
+    for (g = 0; g < ngroup && sizes[g] != image.size; ++g)
+      {;}
+    if (g == ngroup)
+      sizes[ngroup++] = image.size;
+    group[i] = g;
+  }
+  for (g = 0; g <= ngroup; ++g)
+    starts[g] = 0;
+  for (i = 0; i < xf->nimage; ++i)
+    ++starts[group[i] + 1];
+  for (g = 0; g < ngroup; ++g)
+    starts[g + 1] += starts[g];
+  /* sizes is reused as insertion point of each group. */
+  for (g = 0; g < ngroup; ++g)
+    sizes[g] = starts[g];
+  for (i = 0; i < xf->nimage; ++i)
+    members[sizes[group[i]]++] = i;
+  free (sizes);
+  free (group);
+  return ngroup;
+}
+
+int saveConfAndGroupPNGs (const xcurFile* xf, const char* xcurFilePart,
+                          int suffix, FILE* conffp, const char* imagePrefix,
+                          const char* outdir, convContext *ctxs, int jobs,
+                          cursorStats *stats, manifestEntry *entry)
+{ /* write an atlas or APNG for each nominal size, and index of images in
+   * atlases or config-file of APNGs. return 1 if success, 0 if fail. */
+  int i, g, n;
+  int ngroup;
+  int ret;
+  char pngName[PATH_MAX];
+  int *members = malloc ((xf->nimage ? xf->nimage : 1) * sizeof (int));
+  int *starts = malloc ((xf->nimage + 1) * sizeof (int));
+  int *groupOf = malloc ((xf->nimage ? xf->nimage : 1) * sizeof (int));
+  int *cellOf = malloc ((xf->nimage ? xf->nimage : 1) * sizeof (int));
+  atlasLayout *layouts;
+  groupArgs a;
+  writeGroup writes = {0, 0};
+  xcurImage image;
+  double start = 0;
+  extern int batch;
+  extern int apng;
+  extern int suffix_width;
+
+  if (stats)
+    start = now ();
+  if (!batch)
+  {
+    VERBOSE_PRINT ("Converting cursor...\n");
+  }
+  ngroup = (members && starts && groupOf && cellOf) ?
+           groupBySize (xf, members, starts) : -1;
+  layouts = malloc ((ngroup > 0 ? ngroup : 1) * sizeof (atlasLayout));
+  if (ngroup == -1 || !layouts)
+  {
+    fprintf (stderr, "Cannot allocate memory for %s!\n",
+             apng ? "APNGs" : "atlases");
+    free (members); free (starts); free (groupOf); free (cellOf);
+    free (layouts);
+    return 0;
+  }
+  for (g = 0; g < ngroup; ++g)
+  { /* cells are arranged almost square. */
+    n = starts[g + 1] - starts[g];
+    for (layouts[g].columns = 1;
+         layouts[g].columns * layouts[g].columns < n; ++layouts[g].columns)
+      {;}
+    layouts[g].cellWidth = layouts[g].cellHeight = 0;
+    for (i = starts[g]; i < starts[g + 1]; ++i)
+    {
+      getXcursorImage (xf, members[i], &image);
+      if (image.version != 1)
+      {
+        fprintf(stderr, "xcur2png can only retrieve Xcursor version 1.\n");
+        free (members); free (starts); free (groupOf); free (cellOf);
+        free (layouts);
+        return 0;
+      }
+      if (image.width > layouts[g].cellWidth)
+        layouts[g].cellWidth = image.width;
+      if (image.height > layouts[g].cellHeight)
+        layouts[g].cellHeight = image.height;
+      groupOf[members[i]] = g;
+      cellOf[members[i]] = i - starts[g];
+    }
+  }
+  for (g = 0; apng && g < ngroup; ++g)
+  { /* an APNG has only one hotspot, which config-file gives. */
+    xcurImage first;
+    getXcursorImage (xf, members[starts[g]], &first);
+    for (i = starts[g] + 1; i < starts[g + 1]; ++i)
+    {
+      getXcursorImage (xf, members[i], &image);
+      if (image.xhot != first.xhot || image.yhot != first.yhot)
+      {
+        fprintf (stderr, "Hotspot of \"%s\" of size %d moves between "
+                 "frames, so it cannot be written to an APNG!\n",
+                 xcurFilePart, first.size);
+        free (members); free (starts); free (groupOf); free (cellOf);
+        free (layouts);
+        return 0;
+      }
+    }
+  }
+  if (ngroup > 0 && suffix > INT_MAX - (ngroup - 1))
+  {
+    fprintf(stderr,"Sorry, suffix is too large.\n");
+    ngroup = 0;
+  }
+  ret = snprintf(pngName, sizeof(pngName), "%s/%s_%0*d.%s", outdir,
+                 xcurFilePart, suffix_width, suffix + (ngroup ? ngroup - 1 : 0),
+                 xcur2pngExtension (conv_options.format));
+  if (ret < 0 || ret >= sizeof (pngName))
+  {
+    fprintf(stderr, "Cannot set filename of output PNG!\n");
+    ngroup = 0;
+  }
+
+  if (apng)
+  { /* Write config-file which has an APNG for each size.
+     * Hotspot is the same in all frames. */
+    fprintf (conffp,"#size\txhot\tyhot\tPath to APNG image\n");
+    for (g = 0; g < ngroup; ++g)
+    {
+      getXcursorImage (xf, members[starts[g]], &image);
+      fprintf (conffp, "%d\t%d\t%d\t%s%s_%0*d.png\n", image.size,
+               image.xhot, image.yhot, imagePrefix, xcurFilePart, suffix_width,
+               suffix + g);
+    }
+  }
+  else
+  { /* Write index in order of images in Xcursor. */
+    fprintf (conffp,"#size\txhot\tyhot\tPath to PNG image\tx\ty\twidth\theight\tdelay\n");
+  }
+  for (i = 0; i < xf->nimage && !apng; ++i)
+  {
+    const atlasLayout *l = layouts + groupOf[i];
+    if (groupOf[i] >= ngroup)
+      continue;
+    getXcursorImage (xf, i, &image);
+    fprintf (conffp, "%d\t%d\t%d\t%s%s_%0*d.%s\t%d\t%d\t%d\t%d\t%d\n",
+             image.size, image.xhot, image.yhot, imagePrefix, xcurFilePart,
+             suffix_width, suffix + groupOf[i], xcur2pngExtension (conv_options.format),
+             (cellOf[i] % l->columns) * l->cellWidth,
+             (cellOf[i] / l->columns) * l->cellHeight, image.width,
+             image.height, image.delay);
+  }
+  if (stats)
+  {
+    stats->conf = now () - start;
+    stats->npng = ngroup;
+    /* without memory, only statistics of whole Xcursor are reported. */
+    stats->frames = calloc (ngroup ? ngroup : 1, sizeof (frameStats));
+    for (g = 0; stats->frames && g < ngroup; ++g)
+      stats->frames[g].image = members[starts[g]];
+  }
+  if (entry)
+  { /* an atlas or APNG has many images, so it is always written again. */
+    entry->pngs = calloc (ngroup > 0 ? ngroup : 1, sizeof (manifestPng));
+    entry->npng = entry->pngs ? ngroup : 0;
+    for (g = 0; g < entry->npng; ++g)
+    {
+      snprintf (pngName, sizeof (pngName), "%s/%s_%0*d.%s", outdir,
+                xcurFilePart, suffix_width, suffix + g, xcur2pngExtension (conv_options.format));
+      entry->pngs[g].name = strdup (pngName);
+      if (!entry->pngs[g].name)
+        break;
+    }
+    if (!entry->pngs || g < entry->npng)
+    { /* cursor fails, so that it is converted again next time. */
+      fprintf (stderr, "Cannot allocate memory for manifest!\n");
+      free (members); free (starts); free (groupOf); free (cellOf);
+      free (layouts);
+      return 0;
+    }
+  }
+
+  a.xf = xf;
+  a.write = apng ? writeApngFromXcur : writeAtlasFromXcur;
+  a.members = members;
+  a.starts = starts;
+  a.layouts = layouts;
+  a.xcurFilePart = xcurFilePart;
+  a.suffix = suffix;
+  a.outdir = outdir;
+  a.ctxs = ctxs;
+  a.stats = stats ? stats->frames : NULL;
+  a.writes = &writes;
+  a.failed = 0;
+  pthread_mutex_init (&a.lock, NULL);
+  runJobs (ngroup, jobs, saveGroupJob, &a);
+  pthread_mutex_destroy (&a.lock);
+  if (!waitWrites (&writes))
+    a.failed = 1;
+  free (members);
+  free (starts);
+  free (groupOf);
+  free (cellOf);
+  free (layouts);
+  if (a.failed)
+  {
+    fprintf (stderr, "Error ocurred in function %s.\n",
+             apng ? "writeApngFromXcur" : "writeAtlasFromXcur");
+    return 0;
+  }
+  if (ngroup < 1 && xf->nimage > 0)
+    return 0;
+  if (!batch)
+    fprintf (stderr, "\nConversion successfully done!(%d images were output.)\n", ngroup);
+  return 1;
+}
+
+void saveGroupJob (int index, int worker, void *arg)
+{ /* write index-th atlas or APNG. */
+  groupArgs *a = arg;
+  char pngName[PATH_MAX];
+  int ret = 1;
+  extern int dry_run;
+  extern int suffix_width;
+
+  if (!dry_run)
+  {
+    snprintf (pngName, sizeof (pngName), "%s/%s_%0*d.%s", a->outdir,
+              a->xcurFilePart, suffix_width, a->suffix + index,
+              xcur2pngExtension (conv_options.format));
+    ret = a->write (a->ctxs + worker, a->xf, a->members + a->starts[index],
+                    a->starts[index + 1] - a->starts[index],
+                    a->layouts + index, pngName,
+                    a->stats ? a->stats + index : NULL, a->writes);
+  }
+  if (ret == -1)
+  {
+    pthread_mutex_lock (&a->lock);
+    a->failed = 1;
+    pthread_mutex_unlock (&a->lock);
+  }
+  return;
+}
+
+int buildXcursor (const char *conf, const char *out, int jobs)
+{ /* build an Xcursor from config-file which is accepted by xcursorgen.
+   * PNGs are decoded in parallel and the Xcursor is written in one pass.
+   * return 1 if success, 0 if fail. */
+  confEntry *entries = NULL;
+  decodeArgs d;
+  const char *raw_name = rawName (conf);
+  char name[PATH_MAX];
+  int len;
+  int ret_val = 1;
+  int n, i;
+  extern int dry_run;
+  extern int batch;
+
+  if (!raw_name)
+    return 0;
+  len = strlen (raw_name);
+  n = readConf (conf, &entries);
+  if (n < 0)
+    return 0;
+  if (n == 0)
+  {
+    fprintf (stderr, "No image is found in \"%s\"!\n", conf);
+    free (entries);
+    return 0;
+  }
+
+  /* Xcursor is named after config-file without ".conf". If config-file
+   * has no ".conf", ".xcur" is appended not to overwrite it. */
+  if (len > 5 && strcmp (raw_name + len - 5, ".conf") == 0)
+    i = snprintf (name, sizeof (name), "%s/%.*s", out, len - 5, raw_name);
+  else
+    i = snprintf (name, sizeof (name), "%s/%s.xcur", out, raw_name);
+  if (i < 0 || i >= sizeof (name))
+  {
+    fprintf (stderr, "Cannot set filename of output Xcursor!\n");
+    ret_val = 0;
+  }
+
+  if (ret_val)
+  {
+    if (!batch)
+      VERBOSE_PRINT ("Building \"%s\"...\n", name);
+    d.entries = entries;
+    d.total = n;
+    d.failed = 0;
+    d.done = 0;
+    pthread_mutex_init (&d.lock, NULL);
+    runJobs (n, jobs, decodePngJob, &d);
+    pthread_mutex_destroy (&d.lock);
+    if (!batch)
+      VERBOSE_PRINT ("\n");
+    if (d.failed)
+      ret_val = 0;
+  }
+  if (ret_val && !dry_run)
+  {
+    ret_val = writeXcursorFile (name, entries, n);
+  }
+  if (ret_val && !batch)
+    fprintf (stderr, "Building successfully done!(%d images were read.)\n", n);
+
+  for (i = 0; i < n; ++i)
+  {
+    free (entries[i].path);
+    free (entries[i].pixels);
+  }
+  free (entries);
+  return ret_val;
+}
+
+int readConf (const char *conf, confEntry **entriesp)
+{ /* read config-file in the same way as xcursorgen. Relative paths to
+   * PNG images are relative to directory of config-file.
+   * return number of entries, or -1 if fail. */
+  FILE *fp;
+  char line[CONF_LINE_MAX];
+  char png[CONF_LINE_MAX];
+  const char *slash = strrchr (conf, '/');
+  int dirLength = slash ? slash - conf + 1 : 0; /* length of "dir/". */
+  int size, xhot, yhot, delay;
+  int n = 0, max = 16, lineno = 0;
+  int bad = 0;
+  confEntry *entries;
+
+  fp = fopen (conf, "r");
+  if (!fp)
+  {
+    int e = errno;
+    fprintf (stderr, "Cannot open \"%s\":%s\n", conf, strerror (e));
+    return -1;
+  }
+  entries = malloc (max * sizeof (confEntry));
+  if (!entries)
+  {
+    fprintf (stderr, "Cannot allocate memory for \"%s\".\n", conf);
+    fclose (fp);
+    return -1;
+  }
+  while (fgets (line, sizeof (line), fp))
+  {
+    int ret;
+    ++lineno;
+    if (line[0] == '#' || line[strspn (line, " \t\r\n")] == '\0')
+      continue;
+    ret = sscanf (line, "%d %d %d %4095s %d", &size, &xhot, &yhot, png, &delay);
+    if (ret < 4 || size <= 0 || xhot < 0 || yhot < 0 || (ret == 5 && delay < 0))
+    {
+      fprintf (stderr, "%s:%d: Bad config-file data!\n", conf, lineno);
+      bad = 1;
+      break;
+    }
+    if (ret == 4)
+      delay = 50; /* default of xcursorgen. */
+    if (n == max)
+    { /* entries read so far are freed below if realloc fails. */
+      confEntry *grown = realloc (entries, max * 2 * sizeof (confEntry));
+      if (!grown)
+      {
+        fprintf (stderr, "Cannot allocate memory for \"%s\".\n", conf);
+        bad = 1;
+        break;
+      }
+      entries = grown;
+      max *= 2;
+    }
+    entries[n].size = size;
+    entries[n].xhot = xhot;
+    entries[n].yhot = yhot;
+    entries[n].delay = delay;
+    entries[n].line = lineno;
+    entries[n].width = entries[n].height = 0;
+    entries[n].pixels = NULL;
+    entries[n].path = malloc (dirLength + strlen (png) + 1);
+    if (!entries[n].path)
+    {
+      fprintf (stderr, "Cannot allocate memory for \"%s\".\n", conf);
+      bad = 1;
+      break;
+    }
+    sprintf (entries[n].path, "%.*s%s", (png[0] == '/') ? 0 : dirLength,
+             conf, png);
+    ++n;
+  }
+  if (bad || ferror (fp))
+  {
+    for (--n; n >= 0; --n)
+      free (entries[n].path);
+    free (entries);
+    fclose (fp);
+    return -1;
+  }
+  fclose (fp);
+  *entriesp = entries;
+  return n;
+}
+
+void decodePngJob (int index, int worker, void *arg)
+{ /* decode index-th PNG. */
+  decodeArgs *d = arg;
+  int ret = readPngFile (d->entries + index);
+  extern int batch;
+  pthread_mutex_lock (&d->lock);
+  if (!ret)
+    d->failed = 1;
+  if (!batch)
+    printProgress (d->done, d->total);
+  ++d->done;
+  pthread_mutex_unlock (&d->lock);
+  return;
+}
+
+int readPngFile (confEntry *entry)
+{ /* decode PNG of entry to premultiplied ARGB pixels.
+   * return 1 if success, 0 if fail. */
+  FILE *fp;
+  png_structp png_ptr;
+  png_infop info_ptr;
+  png_uint_32 width, height;
+  int depth, color, i;
+  png_bytep *volatile rows = NULL; /* used after longjmp. */
+
+  fp = fopen (entry->path, "rb");
+  if (!fp)
+  {
+    int e = errno;
+    fprintf (stderr, "\nCannot open \"%s\":%s\n", entry->path, strerror (e));
+    return 0;
+  }
+  png_ptr = png_create_read_struct (PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+  info_ptr = png_ptr ? png_create_info_struct (png_ptr) : NULL;
+  if (!info_ptr)
+  {
+    png_destroy_read_struct (&png_ptr, NULL, NULL);
+    fclose (fp);
+    return 0;
+  }
+  if (setjmp (png_jmpbuf (png_ptr)))
+  { /* libpng jumps here when PNG is broken. */
+    fprintf (stderr, "\n\"%s\" is not a valid PNG image!\n", entry->path);
+    png_destroy_read_struct (&png_ptr, &info_ptr, NULL);
+    free (rows);
+    free (entry->pixels);
+    entry->pixels = NULL;
+    fclose (fp);
+    return 0;
+  }
+  png_init_io (png_ptr, fp);
+  png_read_info (png_ptr, info_ptr);
+  png_get_IHDR (png_ptr, info_ptr, &width, &height, &depth, &color,
+                NULL, NULL, NULL);
+  if (width > XCURSOR_IMAGE_MAX_SIZE || height > XCURSOR_IMAGE_MAX_SIZE ||
+      entry->xhot > width || entry->yhot > height)
+  {
+    fprintf (stderr, "\n%s: size or hotspot of image is out of range!\n",
+             entry->path);
+    png_destroy_read_struct (&png_ptr, &info_ptr, NULL);
+    fclose (fp);
+    return 0;
+  }
+
+  /* Every PNG is read as 8 bit BGRA, which is ARGB in little endian. */
+  if (color == PNG_COLOR_TYPE_PALETTE)
+    png_set_palette_to_rgb (png_ptr);
+  if (color == PNG_COLOR_TYPE_GRAY && depth < 8)
+    png_set_expand_gray_1_2_4_to_8 (png_ptr);
+  if (png_get_valid (png_ptr, info_ptr, PNG_INFO_tRNS))
+    png_set_tRNS_to_alpha (png_ptr);
+  if (depth == 16)
+    png_set_strip_16 (png_ptr);
+  if (color == PNG_COLOR_TYPE_GRAY || color == PNG_COLOR_TYPE_GRAY_ALPHA)
+    png_set_gray_to_rgb (png_ptr);
+  png_set_filler (png_ptr, 0xff, PNG_FILLER_AFTER);
+  png_set_bgr (png_ptr);
+  png_set_interlace_handling (png_ptr);
+  png_read_update_info (png_ptr, info_ptr);
+
+  entry->pixels = malloc ((size_t) width * height * 4);
+  rows = malloc (height * sizeof (png_bytep));
+  if (!entry->pixels || !rows)
+    png_error (png_ptr, "Cannot allocate memory");
+  for (i = 0; i < height; ++i)
+  {
+    rows[i] = entry->pixels + (size_t) width * i * 4;
+  }
+  png_read_image (png_ptr, rows);
+  png_read_end (png_ptr, NULL);
+  png_destroy_read_struct (&png_ptr, &info_ptr, NULL);
+  free (rows);
+  fclose (fp);
+
+  premultiplyPixels (entry->pixels, (size_t) width * height);
+  entry->width = width;
+  entry->height = height;
+  return 1;
+}
+
+void premultiplyPixels (unsigned char *pixels, size_t n)
+{ /* premultiply n BGRA pixels by alpha in place. Same as xcursorgen,
+   * (value * alpha / 255) is used. x / 255 equals (x * 0x8081) >> 23
+   * for x < 65536, so the loop has no division and can be vectorized. */
+  size_t i;
+  for (i = 0; i < n; i++, pixels += 4)
+  {
+    unsigned int alpha = pixels[3];
+    pixels[0] = (pixels[0] * alpha * 0x8081) >> 23;
+    pixels[1] = (pixels[1] * alpha * 0x8081) >> 23;
+    pixels[2] = (pixels[2] * alpha * 0x8081) >> 23;
+  }
+  return;
+}
+
+void putUInt32LE (unsigned char *p, XcursorUInt value)
+{ /* Xcursor is always little endian. */
+  p[0] = value;
+  p[1] = value >> 8;
+  p[2] = value >> 16;
+  p[3] = value >> 24;
+  return;
+}
+
+int writeXcursorFile (const char *name, const confEntry *entries, int n)
+{ /* write n images to Xcursor file in order of entries.
+   * return 1 if success, 0 if fail. */
+  unsigned char header[XCURSOR_IMAGE_HEADER_LEN];
+  size_t position = XCURSOR_FILE_HEADER_LEN + (size_t) n * XCURSOR_FILE_TOC_LEN;
+  FILE *fp;
+  int i;
+
+  fp = fopen (name, "wb");
+  if (!fp)
+  {
+    int e = errno;
+    fprintf (stderr, "Cannot open \"%s\":%s\n", name, strerror (e));
+    return 0;
+  }
+  /* File header is "Xcur", header length, version and ntoc. */
+  putUInt32LE (header, XCURSOR_MAGIC);
+  putUInt32LE (header + 4, XCURSOR_FILE_HEADER_LEN);
+  putUInt32LE (header + 8, XCURSOR_FILE_VERSION);
+  putUInt32LE (header + 12, n);
+  fwrite (header, 1, XCURSOR_FILE_HEADER_LEN, fp);
+  /* Each entry of table of contents is type, subtype and position. */
+  for (i = 0; i < n; ++i)
+  {
+    putUInt32LE (header, XCURSOR_IMAGE_TYPE);
+    putUInt32LE (header + 4, entries[i].size);
+    putUInt32LE (header + 8, position);
+    fwrite (header, 1, XCURSOR_FILE_TOC_LEN, fp);
+    position += XCURSOR_IMAGE_HEADER_LEN
+                + (size_t) entries[i].width * entries[i].height * 4;
+  }
+  /* Image chunk is header, type, subtype, version, width, height,
+   * xhot, yhot, delay and pixels. */
+  for (i = 0; i < n; ++i)
+  {
+    putUInt32LE (header, XCURSOR_IMAGE_HEADER_LEN);
+    putUInt32LE (header + 4, XCURSOR_IMAGE_TYPE);
+    putUInt32LE (header + 8, entries[i].size);
+    putUInt32LE (header + 12, XCURSOR_IMAGE_VERSION);
+    putUInt32LE (header + 16, entries[i].width);
+    putUInt32LE (header + 20, entries[i].height);
+    putUInt32LE (header + 24, entries[i].xhot);
+    putUInt32LE (header + 28, entries[i].yhot);
+    putUInt32LE (header + 32, entries[i].delay);
+    fwrite (header, 1, XCURSOR_IMAGE_HEADER_LEN, fp);
+    fwrite (entries[i].pixels, 4, (size_t) entries[i].width * entries[i].height,
+            fp);
+  }
+  if (ferror (fp) | fclose (fp))
+  {
+    fprintf (stderr, "Cannot write \"%s\".\n", name);
+    return 0;
+  }
+  return 1;
+}
+
+void loadManifest (const char *out, const char *cwd, int suffix)
+{ /* read manifest of last conversion from out. Manifest written with other
+   * options or in other directory is not used, because config-file and
+   * PNGs depend on them. */
+  extern manifestS manifest;
+  extern xcur2pngOptions conv_options;
+  extern int atlas;
+  extern int apng;
+  extern int suffix_width;
+  FILE *fp;
+  FILE *strm;
+  char *line = NULL;
+  size_t lineSize = 0;
+  size_t optionsLength = 0;
+  int ok = 1;
+  int i;
+
+  manifest.path = malloc (strlen (out) + sizeof (MANIFEST_NAME) + 1);
+  strm = open_memstream (&manifest.options, &optionsLength);
+  if (!manifest.path || !strm)
+  {
+    fprintf (stderr, "Cannot allocate memory for manifest!\n");
+    exit (1);
+  }
+  sprintf (manifest.path, "%s/%s", out, MANIFEST_NAME);
+  fprintf (strm, "options\t%d %d %d %d %d %d %d %d %d %d %d ",
+           conv_options.zlibLevel, conv_options.zlibStrategy,
+           conv_options.pngFilters, conv_options.dedupe, atlas, apng, suffix,
+           suffix_width, conv_options.firstFrame, conv_options.lastFrame,
+           conv_options.format);
+  for (i = 0; i < conv_options.nsizes; ++i)
+    fprintf (strm, "%s%u", i ? "," : "", conv_options.sizes[i]);
+  fprintf (strm, "\t%s\n", cwd);
+  /* options are NULL if the last allocation by fclose failed. */
+  if (fclose (strm) != 0 || !manifest.options)
+  {
+    fprintf (stderr, "Cannot allocate memory for manifest!\n");
+    exit (1);
+  }
+
+  fp = fopen (manifest.path, "r");
+  if (!fp)
+    return;
+  if (getline (&line, &lineSize, fp) < 0 ||
+      strcmp (line, MANIFEST_HEADER) != 0 ||
+      getline (&line, &lineSize, fp) < 0 ||
+      strcmp (line, manifest.options) != 0)
+    ok = 0;
+  while (ok && getline (&line, &lineSize, fp) >= 0)
+  {
+    ok = readManifestLine (line);
+  }
+  if (!ok)
+  { /* everything is converted again. */
+    VERBOSE_PRINT ("\"%s\" is not used because options are changed "
+                   "or it cannot be read.\n", manifest.path);
+    for (i = 0; i < manifest.nentry; ++i)
+      freeManifestEntry (manifest.entries + i);
+    manifest.nentry = 0;
+  }
+  free (line);
+  fclose (fp);
+  return;
+}
+
+int readManifestLine (char *line)
+{ /* add a line of manifest to manifest. A line is "cursor", size,
+   * modification time, hash, path of Xcursor and path of config-file,
+   * or "png", hash and path of PNG written from last Xcursor.
+   * return 0 if line is broken. */
+  extern manifestS manifest;
+  manifestEntry *e;
+  manifestPng *png;
+  char *p = line;
+  char *type, *size, *sec, *hash, *cursor, *conf, *end;
+
+  line[strcspn (line, "\n")] = '\0';
+  type = nextField (&p);
+  if (strcmp (type, "cursor") == 0)
+  {
+    size = nextField (&p);
+    sec = nextField (&p);
+    hash = nextField (&p);
+    cursor = nextField (&p);
+    conf = nextField (&p);
+    if (!conf || p)
+      return 0;
+    if (manifest.nentry == manifest.maxEntry)
+    { /* manifest which cannot be read is not used, as if broken. */
+      int max = manifest.maxEntry ? manifest.maxEntry * 2 : 64;
+      e = realloc (manifest.entries, max * sizeof (manifestEntry));
+      if (!e)
+        return 0;
+      manifest.entries = e;
+      manifest.maxEntry = max;
+    }
+    e = manifest.entries + manifest.nentry++;
+    memset (e, 0, sizeof (manifestEntry));
+    e->cursor = strdup (cursor);
+    e->conf = strdup (conf);
+    if (!e->cursor || !e->conf)
+      return 0;
+    e->size = strtoull (size, &end, 10);
+    if (end == size || *end)
+      return 0;
+    e->mtime.tv_sec = strtoll (sec, &end, 10);
+    if (end == sec || *end != '.')
+      return 0;
+    e->mtime.tv_nsec = strtol (end + 1, &end, 10);
+    if (*end)
+      return 0;
+    e->hash = strtoull (hash, &end, 16);
+    return end != hash && *end == '\0';
+  }
+  else if (strcmp (type, "png") == 0 && manifest.nentry > 0)
+  {
+    e = manifest.entries + manifest.nentry - 1;
+    hash = nextField (&p);
+    cursor = nextField (&p);
+    if (!cursor || p)
+      return 0;
+    png = realloc (e->pngs, (e->npng + 1) * sizeof (manifestPng));
+    if (!png)
+      return 0;
+    e->pngs = png;
+    png += e->npng;
+    png->name = strdup (cursor);
+    if (!png->name)
+      return 0;
+    ++e->npng;
+    png->hash = strtoull (hash, &end, 16);
+    return end != hash && *end == '\0';
+  }
+  return 0;
+}
+
+char *nextField (char **p)
+{ /* return field at *p and move *p to the next field.
+   * Fields are separated by tab. *p is NULL after the last field. */
+  char *field = *p;
+  char *tab;
+  if (!field)
+    return NULL;
+  tab = strchr (field, '\t');
+  if (tab)
+  {
+    *tab = '\0';
+    *p = tab + 1;
+  }
+  else
+    *p = NULL;
+  return field;
+}
+
+int saveManifest (void)
+{ /* write manifest to temporary file and rename it, so that broken
+   * manifest is never left. return 1 if success, 0 if fail. */
+  extern manifestS manifest;
+  char *tmp = malloc (strlen (manifest.path) + 5);
+  FILE *fp;
+  int i, j;
+  int ret = 1;
+
+  if (!tmp)
+  {
+    fprintf (stderr, "Cannot allocate memory for manifest!\n");
+    return 0;
+  }
+  sprintf (tmp, "%s.tmp", manifest.path);
+  /* sorted, so that manifest does not depend on order of jobs. */
+  qsort (manifest.entries, manifest.nentry, sizeof (manifestEntry),
+         compareManifestEntries);
+  fp = fopen (tmp, "w");
+  if (!fp)
+  {
+    int e = errno;
+    fprintf (stderr, "Cannot open \"%s\":%s\n", tmp, strerror (e));
+    free (tmp);
+    return 0;
+  }
+  fprintf (fp, "%s%s", MANIFEST_HEADER, manifest.options);
+  for (i = 0; i < manifest.nentry; ++i)
+  {
+    const manifestEntry *e = manifest.entries + i;
+    /* path which has tab or newline cannot be written. It is converted
+     * again next time. */
+    if (strpbrk (e->cursor, "\t\n") || strpbrk (e->conf, "\t\n"))
+      continue;
+    fprintf (fp, "cursor\t%llu\t%lld.%09ld\t%016llx\t%s\t%s\n", e->size,
+             (long long) e->mtime.tv_sec, (long) e->mtime.tv_nsec,
+             (unsigned long long) e->hash, e->cursor, e->conf);
+    for (j = 0; j < e->npng; ++j)
+    {
+      fprintf (fp, "png\t%016llx\t%s\n", (unsigned long long) e->pngs[j].hash,
+               strpbrk (e->pngs[j].name, "\t\n") ? "" : e->pngs[j].name);
+    }
+  }
+  if (ferror (fp))
+    ret = 0;
+  if (fclose (fp) != 0 || !ret || rename (tmp, manifest.path) != 0)
+  {
+    int e = errno;
+    fprintf (stderr, "Cannot write \"%s\":%s\n", manifest.path, strerror (e));
+    unlink (tmp);
+    ret = 0;
+  }
+  free (tmp);
+  return ret;
+}
+
+int compareManifestEntries (const void *a, const void *b)
+{
+  return strcmp (((const manifestEntry *) a)->cursor,
+                 ((const manifestEntry *) b)->cursor);
+}
+
+int takeManifestEntry (const char *cursor, manifestEntry *entry)
+{ /* move entry of cursor from manifest to entry. If cursor is not in
+   * manifest, entry is cleared. return 1 if found, 0 if not. */
+  extern manifestS manifest;
+  int i;
+  int found = 0;
+  memset (entry, 0, sizeof (manifestEntry));
+  pthread_mutex_lock (&manifest.lock);
+  for (i = 0; i < manifest.nentry; ++i)
+  {
+    if (strcmp (manifest.entries[i].cursor, cursor) == 0)
+    {
+      *entry = manifest.entries[i];
+      manifest.entries[i] = manifest.entries[--manifest.nentry];
+      found = 1;
+      break;
+    }
+  }
+  pthread_mutex_unlock (&manifest.lock);
+  return found;
+}
+
+void putManifestEntry (manifestEntry *entry)
+{ /* move entry to manifest. entry is cleared. If memory cannot be
+   * allocated, entry is freed instead, so that its Xcursor is converted
+   * again next time. */
+  extern manifestS manifest;
+  int ok = entry->cursor && entry->conf;
+  pthread_mutex_lock (&manifest.lock);
+  if (ok && manifest.nentry == manifest.maxEntry)
+  {
+    int max = manifest.maxEntry ? manifest.maxEntry * 2 : 64;
+    manifestEntry *entries = realloc (manifest.entries,
+                                      max * sizeof (manifestEntry));
+    if (entries)
+    {
+      manifest.entries = entries;
+      manifest.maxEntry = max;
+    }
+    else
+      ok = 0;
+  }
+  if (ok)
+    manifest.entries[manifest.nentry++] = *entry;
+  pthread_mutex_unlock (&manifest.lock);
+  if (ok)
+    memset (entry, 0, sizeof (manifestEntry));
+  else
+  {
+    fprintf (stderr, "Cannot allocate memory for manifest. \"%s\" will be "
+                     "converted again next time.\n",
+             entry->cursor ? entry->cursor : "Xcursor");
+    freeManifestEntry (entry);
+  }
+  return;
+}
+
+void freeManifestEntry (manifestEntry *entry)
+{
+  int i;
+  for (i = 0; i < entry->npng; ++i)
+    free (entry->pngs[i].name);
+  free (entry->pngs);
+  free (entry->cursor);
+  free (entry->conf);
+  memset (entry, 0, sizeof (manifestEntry));
+  return;
+}
+
+int cursorIsUnchanged (const manifestEntry *old, const char *conf,
+                       const struct stat *st, const uint64_t *hash)
+{ /* return 1 if Xcursor is same as last conversion and its config-file
+   * and PNGs still exist. If hash is NULL, size and modification time are
+   * compared, otherwise hash of contents is compared. */
+  int i;
+  if (!old->cursor || strcmp (old->conf, conf) != 0)
+    return 0;
+  if (old->size != st->st_size)
+    return 0;
+  if (!hash && (old->mtime.tv_sec != st->st_mtim.tv_sec ||
+                old->mtime.tv_nsec != st->st_mtim.tv_nsec))
+    return 0;
+  if (hash && old->hash != *hash)
+    return 0;
+  if (access (conf, F_OK) != 0)
+    return 0;
+  for (i = 0; i < old->npng; ++i)
+  {
+    if (access (old->pngs[i].name, F_OK) != 0)
+      return 0;
+  }
+  return 1;
+}
+
+int pngIsUnchanged (const manifestEntry *old, int index, const char *name,
+                    uint64_t hash)
+{ /* return 1 if index-th PNG of last conversion has image of hash and
+   * still exists. */
+  return index < old->npng && old->pngs[index].hash == hash && hash != 0 &&
+         strcmp (old->pngs[index].name, name) == 0 && access (name, F_OK) == 0;
+}
+
+uint64_t hashData (const unsigned char *data, size_t length)
+{ /* FNV-1a hash of data, same as hashImage. */
+  uint64_t hash = 14695981039346656037ULL;
+  size_t i;
+  for (i = 0; i < length; ++i)
+  {
+    hash = (hash ^ data[i]) * 1099511628211ULL;
+  }
+  return hash;
+}
+
+char **expandCursors (char *args[], int nargs, int *ncursorsp)
+{ /* return list of Xcursors. directories in args are replaced by files in them.
+   * returned list and its elements must be freed later. */
+  int i, j, n;
+  int count = 0;
+  int max = nargs;
+  char **ret = malloc (max * sizeof (char *));
+  char **list;
+  struct stat buf;
+  struct dirent **entries;
+
+  if (!ret)
+  {
+    fprintf (stderr, "Cannot allocate memory for list of Xcursors.\n");
+    exit (1);
+  }
+  for (i = 0; i < nargs; ++i)
+  {
+    if (stat (args[i], &buf) != 0 || !S_ISDIR (buf.st_mode))
+    { /* Not a directory. Errors are reported when it is loaded. */
+      if (!(ret[count++] = strdup (args[i])))
+      {
+        fprintf (stderr, "Cannot allocate memory for list of Xcursors.\n");
+        exit (1);
+      }
+      continue;
+    }
+    n = scandir (args[i], &entries, NULL, alphasort);
+    if (n < 0)
+    {
+      int e = errno;
+      fprintf (stderr, "%s:%s\n", args[i], strerror (e));
+      exit (1);
+    }
+    max += n;
+    list = realloc (ret, max * sizeof (char *));
+    if (!list)
+    {
+      fprintf (stderr, "Cannot allocate memory for list of Xcursors.\n");
+      exit (1);
+    }
+    ret = list;
+    for (j = 0; j < n; ++j)
+    {
+      char *path;
+      if (entries[j]->d_name[0] != '.')
+      {
+        path = malloc (strlen (args[i]) + strlen (entries[j]->d_name) + 2);
+        if (!path)
+        {
+          fprintf (stderr, "Cannot allocate memory for list of Xcursors.\n");
+          exit (1);
+        }
+        sprintf (path, "%s/%s", args[i], entries[j]->d_name);
+        /* Skip subdirectories and other non regular files. */
+        if (stat (path, &buf) == 0 && S_ISREG (buf.st_mode))
+          ret[count++] = path;
+        else
+          free (path);
+      }
+      free (entries[j]);
+    }
+    free (entries);
+  }
+  *ncursorsp = count;
+  return ret;
+}
+
+int findAliases (char **cursors, int ncursors, int *primary)
+{ /* set primary[i] to index of the first Xcursor which is the same file as
+   * i-th Xcursor (same device and inode) or has the same contents.
+   * primary[i] is i if there is no such Xcursor. Cursor themes have many
+   * aliases made by links, so each of them is converted only once.
+   * return number of aliases. */
+  struct stat *st = malloc ((ncursors ? ncursors : 1) * sizeof (struct stat));
+  uint64_t *hashes = malloc ((ncursors ? ncursors : 1) * sizeof (uint64_t));
+  /* 0: hash is not calculated yet, 1: calculated, -1: cannot be read. */
+  int *state = calloc (ncursors ? ncursors : 1, sizeof (int));
+  const unsigned char *data;
+  size_t length;
+  int i, j, k;
+  int n = 0;
+
+  if (!st || !hashes || !state)
+  { /* aliases are converted as if they were different Xcursors. */
+    for (i = 0; i < ncursors; ++i)
+      primary[i] = i;
+    free (st);
+    free (hashes);
+    free (state);
+    return 0;
+  }
+  for (i = 0; i < ncursors; ++i)
+  {
+    primary[i] = i;
+    if (stat (cursors[i], st + i) != 0 || !S_ISREG (st[i].st_mode))
+    { /* errors are reported when it is converted. */
+      state[i] = -1;
+      continue;
+    }
+    for (j = 0; j < i && primary[i] == i; ++j)
+    {
+      if (primary[j] != j || state[j] == -1 || st[j].st_size != st[i].st_size)
+        continue;
+      if (st[j].st_dev == st[i].st_dev && st[j].st_ino == st[i].st_ino)
+      {
+        primary[i] = j;
+        break;
+      }
+      /* contents are compared only if hashes of them are same. */
+      for (k = 0; k < 2; ++k)
+      {
+        int c = k ? i : j;
+        if (state[c] != 0)
+          continue;
+        data = mapFile (cursors[c], &length);
+        state[c] = data ? 1 : -1;
+        if (data)
+        {
+          hashes[c] = hashData (data, length);
+          munmap ((void *) data, length);
+        }
+      }
+      if (state[i] == 1 && state[j] == 1 && hashes[i] == hashes[j] &&
+          sameContents (cursors[i], cursors[j]))
+        primary[i] = j;
+      if (state[i] == -1)
+        break;
+    }
+    n += (primary[i] != i);
+  }
+  free (st);
+  free (hashes);
+  free (state);
+  return n;
+}
+
+const unsigned char *mapFile (const char *path, size_t *lengthp)
+{ /* map whole file at path to memory. return NULL if fail or file is empty. */
+  int fd;
+  struct stat buf;
+  void *map;
+  fd = open (path, O_RDONLY);
+  if (fd < 0)
+    return NULL;
+  if (fstat (fd, &buf) != 0 || !S_ISREG (buf.st_mode) || buf.st_size == 0)
+  {
+    close (fd);
+    return NULL;
+  }
+  map = mmap (NULL, buf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close (fd);
+  if (map == MAP_FAILED)
+    return NULL;
+  *lengthp = buf.st_size;
+  return map;
+}
+
+int sameContents (const char *a, const char *b)
+{ /* return 1 if files a and b have the same contents. */
+  const unsigned char *dataA, *dataB;
+  size_t lengthA, lengthB;
+  int ret = 0;
+  dataA = mapFile (a, &lengthA);
+  if (!dataA)
+    return 0;
+  dataB = mapFile (b, &lengthB);
+  if (dataB)
+  {
+    ret = lengthA == lengthB && memcmp (dataA, dataB, lengthA) == 0;
+    munmap ((void *) dataB, lengthB);
+  }
+  munmap ((void *) dataA, lengthA);
+  return ret;
+}
+
+int linkAlias (const char *alias, const char *cursor, const char *argconf)
+{ /* make config-file of alias a symbolic link to config-file of cursor,
+   * which refers to PNGs of the same images. Both config-files are in
+   * the same directory. return 1 if success, 0 if fail. */
+  const char *aliasName = rawName (alias);
+  const char *cursorName = rawName (cursor);
+  char *conf;
+  char *target;
+  int ret = 1;
+  if (!aliasName || !cursorName)
+    return 0;
+  if (strcmp (aliasName, cursorName) == 0)
+    return 1;     /* they share one config-file. */
+  conf = makeConfPath (argconf, aliasName);
+  target = makeConfPath (NULL, cursorName);
+  if (!conf || !target || writeSymlink (conf, target) == -1)
+    ret = 0;
+  free (conf);
+  free (target);
+  return ret;
+}
+
+int convertCursor (const char *cursor, const char *argconf, const char *out,
+                   const char *argprefix, int suffix, const char *cwd,
+                   convContext *ctxs, int jobs)
+{ /* convert a Xcursor to conf and PNGs. Path from conf to out in conf is
+   * argprefix if it is not NULL. return 1 if success, 0 if fail. */
+  int ret_val = 0;
+  char *conf;                   /* path of config-file generated by argconf */
+  const char *raw_name = NULL;  /* raw file name of Xcursor */
+  FILE *conf_strm = NULL;       /* stream to config-file */
+  char *confData = NULL;        /* config-file in memory for archive */
+  size_t confLength = 0;
+  char *prefix;                 /* prefix which is prepended to 
+                                   PNG image name of config-file */
+  xcurFile xf;
+  cursorStats stats;
+  int allocations = 0;
+  int i;
+  int unchanged = 0;            /* 1 if Xcursor is same as last conversion */
+  manifestEntry old;            /* manifest of last conversion */
+  manifestEntry entry;          /* manifest of this conversion */
+  struct stat st;
+  extern FILE *stats_strm;
+  extern int dry_run;
+  extern int atlas;
+  extern int apng;
+  extern int incremental;
+  extern int batch;
+  extern archiveS archive;
+
+  memset (&stats, 0, sizeof (stats));
+  if (stats_strm)
+  {
+    stats.total = now ();
+    for (i = 0; i < jobs; ++i)
+      allocations -= ctxs[i].allocations;
+  }
+
+  /* set raw_name and conf name. they are errors of this Xcursor only,
+   * so that server goes on serving other requests. */
+  raw_name = rawName (cursor);
+  conf = raw_name ? makeConfPath (argconf, raw_name) : NULL;
+  if (!conf)
+  {
+    if (stats_strm)
+    {
+      stats.total = now () - stats.total;
+      printStats (cursor, 0, &stats, 0);
+    }
+    return 0;
+  }
+  if (incremental)
+  { /* Xcursor of same size and time as last conversion is not even read. */
+    takeManifestEntry (cursor, &old);
+    memset (&entry, 0, sizeof (entry));
+    if (stat (cursor, &st) != 0)
+      memset (&st, 0, sizeof (st));
+    unchanged = cursorIsUnchanged (&old, conf, &st, NULL);
+  }
+
+  /* Read Xcursor from file specified in argument. */
+  if (stats_strm)
+    stats.read = now ();
+  ret_val = unchanged ? 1 : openXcursorFile (&xf, cursor);
+  if (stats_strm)
+  {
+    stats.read = now () - stats.read;
+    stats.bytesRead = (ret_val && !unchanged) ? xf.length : 0;
+    stats.nimage = (ret_val && !unchanged) ? xf.nimage : 0;
+  }
+  if (ret_val && incremental && !unchanged)
+  { /* Xcursor which is touched but has same contents is not converted. */
+    entry.hash = hashData (xf.data, xf.length);
+    unchanged = cursorIsUnchanged (&old, conf, &st, &entry.hash);
+    if (unchanged)
+      closeXcursorFile (&xf);
+  }
+  if (unchanged)
+  { /* config-file and PNGs of last conversion are kept. */
+    if (!batch)
+      VERBOSE_PRINT ("\"%s\" is not changed since last conversion.\n", cursor);
+    old.size = st.st_size;
+    old.mtime = st.st_mtim;
+    putManifestEntry (&old);
+    free (conf);
+    if (stats_strm)
+    {
+      stats.total = now () - stats.total;
+      printStats (cursor, 1, &stats, 0);
+    }
+    return 1;
+  }
+  /* open stream of conf. It is kept in memory until it is added to archive. */
+  if (archive.format != ARCHIVE_NONE)
+  {
+    conf_strm = open_memstream (&confData, &confLength);
+    if (!conf_strm)
+      fprintf (stderr, "Cannot allocate memory for \"%s\".\n", conf);
+  }
+  else
+    conf_strm = openConfStream (conf);
+  if (!conf_strm)
+  { /* only this Xcursor fails. other Xcursors are still converted. */
+    if (ret_val)
+      closeXcursorFile (&xf);
+    free (conf);
+    return 0;
+  }
+  /* If is ensured that conf_strm is opened and writable. */
+
+  if (!ret_val)
+  {
+    fprintf (stderr, "Can't load Xcursor file \"%s\"!\n", cursor);
+  }
+  else
+  {
+    if (xf.nimage == 0)
+      fprintf (stderr, "No image of \"%s\" is selected.\n", cursor);
+    /* Let's get path from conf to directory where PNG images are written. */
+    if (argprefix)
+      prefix = strdup (argprefix);
+    else
+      prefix = getPrefixFromConfToOut (conf, out, cwd);
+    /* then write conf and PNGs */
+    if (!prefix)
+      ret_val = 0;
+    else if (atlas || apng)
+      ret_val = saveConfAndGroupPNGs (&xf, raw_name, suffix, conf_strm, prefix,
+                                      out, ctxs, jobs,
+                                      stats_strm ? &stats : NULL,
+                                      incremental ? &entry : NULL);
+    else
+      ret_val = saveConfAndPNGs (&xf, raw_name, suffix, conf_strm, prefix, out,
+                                 ctxs, jobs, stats_strm ? &stats : NULL,
+                                 incremental ? &old : NULL,
+                                 incremental ? &entry : NULL);
+    /* free memory */
+    closeXcursorFile (&xf);
+    free (prefix);
+  }
+  if (conf_strm == stdout)
+    fflush (conf_strm);
+  else if (fclose (conf_strm) != 0 && incremental)
+    ret_val = 0;
+  if (archive.format != ARCHIVE_NONE)
+  {
+    if (!addArchiveEntry (conf, (unsigned char *) confData, confLength))
+      ret_val = 0;
+    free (confData);
+  }
+  if (incremental)
+  { /* Xcursor which failed is converted again next time. */
+    if (ret_val)
+    {
+      entry.cursor = strdup (cursor);
+      entry.conf = strdup (conf);
+      entry.size = st.st_size;
+      entry.mtime = st.st_mtim;
+      putManifestEntry (&entry);
+    }
+    else
+      freeManifestEntry (&entry);
+    freeManifestEntry (&old);
+  }
+  free (conf);
+  if (stats_strm)
+  {
+    stats.total = now () - stats.total;
+    stats.filesCreated = (conf_strm != stdout) + (dry_run ? 0 : stats.npng);
+    for (i = 0; i < jobs; ++i)
+      allocations += ctxs[i].allocations;
+    printStats (cursor, ret_val, &stats, allocations);
+    free (stats.frames);
+  }
+  return ret_val;
+}
+
+void *jobWorker (void *workerArg)
+{ /* take jobs from queue one by one until no job is left. */
+  jobWorkerArg *w = workerArg;
+  jobQueue *q = w->queue;
+  int index;
+  for (;;)
+  {
+    pthread_mutex_lock (&q->lock);
+    index = q->next++;
+    pthread_mutex_unlock (&q->lock);
+    if (index >= q->total)
+      break;
+    q->func (index, w->worker, q->arg);
+  }
+  return NULL;
+}
+
+void runJobs (int total, int jobs,
+              void (*func) (int index, int worker, void *arg), void *arg)
+{ /* call func for index 0 to total - 1 with up to jobs threads.
+   * Each thread takes next index when its job is done, so long jobs
+   * don't keep other threads waiting. */
+  int i;
+  int nthreads = (jobs < total) ? jobs : total;
+  pthread_t threads[nthreads > 1 ? nthreads - 1 : 1];
+  jobWorkerArg workers[nthreads > 1 ? nthreads : 1];
+  jobQueue q;
+
+  pthread_mutex_init (&q.lock, NULL);
+  q.next = 0;
+  q.total = total;
+  q.func = func;
+  q.arg = arg;
+  for (i = 0; i < nthreads || i == 0; ++i)
+  {
+    workers[i].queue = &q;
+    workers[i].worker = i;
+  }
+  /* current thread works as worker 0. */
+  for (i = 1; i < nthreads; ++i)
+  {
+    if (pthread_create (threads + i - 1, NULL, jobWorker, workers + i) != 0)
+    {
+      nthreads = i;
+      break;
+    }
+  }
+  jobWorker (workers);
+  for (i = 1; i < nthreads; ++i)
+  {
+    pthread_join (threads[i - 1], NULL);
+  }
+  pthread_mutex_destroy (&q.lock);
+  return;
+}
+
+void convertBatchJob (int index, int worker, void *arg)
+{
+  batchArgs *b = arg;
+  /* Xcursors are already converted in parallel, so frames are not.
+   * Aliases are linked after all Xcursors are converted. */
+  if (b->primary[index] == index)
+    b->results[index] = convertCursor (b->cursors[index], b->argconf, b->out,
+                                       NULL, b->suffix, b->cwd, b->ctxs + worker, 1);
+  pthread_mutex_lock (&b->lock);
+  printProgress (b->done++, b->ncursors);
+  pthread_mutex_unlock (&b->lock);
+  return;
+}
+
+int connectSocket (const char *path)
+{ /* connect to Unix domain socket at path. return -1 if fail. */
+  struct sockaddr_un addr;
+  int fd;
+  int e;
+
+  if (strlen (path) >= sizeof (addr.sun_path))
+  {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  memset (&addr, 0, sizeof (addr));
+  addr.sun_family = AF_UNIX;
+  strcpy (addr.sun_path, path);
+  fd = socket (AF_UNIX, SOCK_STREAM, 0);
+  if (fd == -1)
+    return -1;
+  if (connect (fd, (struct sockaddr *) &addr, sizeof (addr)) != 0)
+  {
+    e = errno;
+    close (fd);
+    errno = e;
+    return -1;
+  }
+  return fd;
+}
+
+int openServerSocket (const char *path)
+{ /* listen on Unix domain socket at path. Socket left by a server which
+   * is no longer running is replaced. return -1 if fail. */
+  struct sockaddr_un addr;
+  struct stat buf;
+  int fd;
+  int e;
+
+  if (strlen (path) >= sizeof (addr.sun_path))
+  {
+    fprintf (stderr, "Path of socket \"%s\" is too long!\n", path);
+    return -1;
+  }
+  if (lstat (path, &buf) == 0 && S_ISSOCK (buf.st_mode))
+  {
+    fd = connectSocket (path);
+    if (fd != -1)
+    {
+      close (fd);
+      fprintf (stderr, "\"%s\" is already served by another process!\n", path);
+      return -1;
+    }
+    unlink (path);
+  }
+  memset (&addr, 0, sizeof (addr));
+  addr.sun_family = AF_UNIX;
+  strcpy (addr.sun_path, path);
+  fd = socket (AF_UNIX, SOCK_STREAM, 0);
+  if (fd == -1 || bind (fd, (struct sockaddr *) &addr, sizeof (addr)) != 0 ||
+      listen (fd, SOMAXCONN) != 0)
+  {
+    e = errno;
+    fprintf (stderr, "Cannot serve on \"%s\":%s\n", path, strerror (e));
+    if (fd != -1)
+      close (fd);
+    return -1;
+  }
+  return fd;
+}
+
+void stopServer (int sig)
+{ /* remove socket, so that next server can be started, and die of sig. */
+  extern char *serve_socket;
+  unlink (serve_socket);
+  signal (sig, SIG_DFL);
+  raise (sig);
+}
+
+void serveConnection (int fd, convContext *ctx)
+{ /* convert Xcursor of each request line from fd and answer "ok" or
+   * "error", tab and the Xcursor. Request line is "convert", suffix,
+   * directory, config-file, prefix of PNGs in config-file and Xcursor
+   * separated by tab. Paths are absolute because client has its own
+   * current directory, and client makes prefix from its relative paths. */
+  FILE *in = fdopen (fd, "r");
+  int answerFd = dup (fd);
+  FILE *answer = (answerFd != -1) ? fdopen (answerFd, "w") : NULL;
+  char *line = NULL;
+  size_t lineSize = 0;
+  ssize_t len;
+
+  while (in && answer && (len = getline (&line, &lineSize, in)) != -1)
+  {
+    char *p = line;
+    char *verb, *suffix, *dir, *conf, *prefix, *cursor;
+    char *end = NULL;
+    long value = -1;
+    int ok = 0;
+
+    if (len > 0 && line[len - 1] == '\n')
+      line[--len] = '\0';
+    verb = nextField (&p);
+    suffix = nextField (&p);
+    dir = nextField (&p);
+    conf = nextField (&p);
+    prefix = nextField (&p);
+    cursor = nextField (&p);
+    if (cursor)
+      value = strtol (suffix, &end, 10);
+    if (!cursor || p || strcmp (verb, "convert") != 0 || end == suffix ||
+        *end || value < 0 || value > INT_MAX || !*conf ||
+        strcmp (conf, "-") == 0 || !*cursor ||
+        cursor[strlen (cursor) - 1] == '/')
+    {
+      fprintf (stderr, "Invalid request!\n");
+      cursor = "";
+    }
+    else if (checkDirectory (dir))
+      ok = convertCursor (cursor, conf, dir, prefix, value, NULL, ctx, 1);
+    fprintf (answer, "%s\t%s\n", ok ? "ok" : "error", cursor);
+    if (fflush (answer) != 0)
+      break;
+  }
+  free (line);
+  if (answer)
+    fclose (answer);
+  else if (answerFd != -1)
+    close (answerFd);
+  if (in)
+    fclose (in);
+  else
+    close (fd);
+  return;
+}
+
+void serveJob (int index, int worker, void *arg)
+{ /* accept connections one by one and serve each of them until client
+   * closes it. */
+  serveArgs *s = arg;
+  int fd;
+  int e;
+
+  for (;;)
+  {
+    fd = accept (s->fd, NULL, NULL);
+    if (fd == -1)
+    {
+      e = errno;
+      if (e == EINTR || e == ECONNABORTED)
+        continue;
+      fprintf (stderr, "Cannot accept connection:%s\n", strerror (e));
+      return;
+    }
+    serveConnection (fd, s->ctxs + worker);
+  }
+}
+
+int serve (int jobs)
+{ /* serve conversions on socket of --serve with jobs threads until the
+   * process is killed. Options of conversion are fixed at start, so
+   * threads share them without lock. return 0 if serving stopped. */
+  extern char *serve_socket;
+  extern int batch;
+  extern int write_threads;
+  serveArgs s;
+  int i;
+
+  s.fd = openServerSocket (serve_socket);
+  if (s.fd == -1)
+    return 0;
+  signal (SIGINT, stopServer);
+  signal (SIGTERM, stopServer);
+  /* client may go away before it is answered. */
+  signal (SIGPIPE, SIG_IGN);
+  /* messages of each Xcursor are suppressed as in batch conversion. */
+  batch = 1;
+  if (write_threads > 0)
+    startWriter (write_threads);
+  s.ctxs = malloc (jobs * sizeof (convContext));
+  if (!s.ctxs)
+  {
+    fprintf (stderr, "Cannot allocate memory\n");
+    exit (1);
+  }
+  for (i = 0; i < jobs; ++i)
+  {
+    initConvContext (s.ctxs + i);
+  }
+  VERBOSE_PRINT ("Serving on \"%s\" with %d threads...\n", serve_socket, jobs);
+  runJobs (jobs, jobs, serveJob, &s);
+  for (i = 0; i < jobs; ++i)
+  {
+    freeConvContext (s.ctxs + i);
+  }
+  free (s.ctxs);
+  stopWriter ();
+  close (s.fd);
+  unlink (serve_socket);
+  return 0;
+}
+
+char *absolutePath (const char *path, const char *cwd)
+{ /* return path relative to cwd as absolute path. returned path must be
+   * freed later. */
+  char *ret;
+  if (path[0] == '/')
+    ret = strdup (path);
+  else if ((ret = malloc (strlen (cwd) + strlen (path) + 2)) != NULL)
+    sprintf (ret, "%s/%s", cwd, path);
+  if (!ret)
+  {
+    fprintf (stderr, "Cannot allocate memory\n");
+    exit (1);
+  }
+  return ret;
+}
+
+void connectServer (batchArgs *b, int n)
+{ /* open a connection to server of --connect for each of n workers. */
+  extern char *connect_socket;
+  int i;
+  int fd;
+  int e;
+
+  b->requests = malloc (n * sizeof (FILE *));
+  b->answers = malloc (n * sizeof (FILE *));
+  if (!b->requests || !b->answers)
+  {
+    fprintf (stderr, "Cannot allocate memory\n");
+    exit (1);
+  }
+  for (i = 0; i < n; ++i)
+  {
+    fd = connectSocket (connect_socket);
+    if (fd == -1)
+    {
+      e = errno;
+      fprintf (stderr, "Cannot connect to \"%s\":%s\n", connect_socket,
+               strerror (e));
+      exit (1);
+    }
+    b->requests[i] = fdopen (fd, "w");
+    b->answers[i] = fdopen (dup (fd), "r");
+    if (!b->requests[i] || !b->answers[i])
+    {
+      fprintf (stderr, "Cannot allocate memory\n");
+      exit (1);
+    }
+  }
+  /* server may close connection before it answers. */
+  signal (SIGPIPE, SIG_IGN);
+  return;
+}
+
+void disconnectServer (batchArgs *b, int n)
+{
+  int i;
+  for (i = 0; i < n; ++i)
+  {
+    fclose (b->requests[i]);
+    fclose (b->answers[i]);
+  }
+  free (b->requests);
+  free (b->answers);
+  return;
+}
+
+void convertRemoteJob (int index, int worker, void *arg)
+{ /* ask server to convert index-th Xcursor through connection of worker. */
+  batchArgs *b = arg;
+  const char *cursor = b->cursors[index];
+  const char *raw_name;
+  char *conf = NULL;
+  char *prefix = NULL;
+  char *paths[3];
+  char *line = NULL;
+  size_t lineSize = 0;
+  int i;
+
+  if (b->primary[index] == index)
+  { /* config-file is the same as that of conversion in this process. */
+    raw_name = rawName (cursor);
+    if (raw_name)
+      conf = makeConfPath (b->argconf, raw_name);
+    if (conf)
+      prefix = getPrefixFromConfToOut (conf, b->out, b->cwd);
+  }
+  if (prefix)
+  {
+    paths[0] = absolutePath (b->out, b->cwd);
+    paths[1] = absolutePath (conf, b->cwd);
+    paths[2] = absolutePath (cursor, b->cwd);
+    if (strpbrk (paths[0], "\t\n") || strpbrk (paths[1], "\t\n") ||
+        strpbrk (paths[2], "\t\n") || strpbrk (prefix, "\t\n"))
+      fprintf (stderr, "Path of \"%s\" cannot be sent to server.\n", cursor);
+    else if (fprintf (b->requests[worker], "convert\t%d\t%s\t%s\t%s\t%s\n",
+                      b->suffix, paths[0], paths[1], prefix, paths[2]) < 0 ||
+             fflush (b->requests[worker]) != 0 ||
+             getline (&line, &lineSize, b->answers[worker]) == -1)
+      fprintf (stderr, "Connection to server is lost.\n");
+    else if (strncmp (line, "ok\t", 3) == 0)
+      b->results[index] = 1;
+    else
+      fprintf (stderr, "Server cannot convert \"%s\"!\n", cursor);
+    for (i = 0; i < 3; ++i)
+    {
+      free (paths[i]);
+    }
+    free (line);
+  }
+  free (prefix);
+  free (conf);
+  pthread_mutex_lock (&b->lock);
+  printProgress (b->done++, b->ncursors);
+  pthread_mutex_unlock (&b->lock);
+  return;
+}
+
+
+void printProblem (void *closure, const char *message)
+{ /* problem callback of xcur2pngCheck. closure is path to Xcursor. */
+  printf ("%s: %s\n", (const char *) closure, message);
+  return;
+}
+
+int checkCursors (char **cursors, int ncursors)
+{ /* check header, table of contents and image chunk headers of each
+   * Xcursor without reading pixels, and report problems to stdout.
+   * return 0 if all of them are valid, 1 if not. */
+  extern int quiet;
+  int fd;
+  struct stat buf;
+  void *map;
+  int nimage;
+  int nvalid = 0;
+  int i;
+
+  for (i = 0; i < ncursors; ++i)
+  {
+    fd = open (cursors[i], O_RDONLY);
+    if (fd < 0 || fstat (fd, &buf) != 0)
+    {
+      int e = errno;
+      printf ("%s: %s\n", cursors[i], strerror (e));
+      if (fd >= 0)
+        close (fd);
+      continue;
+    }
+    if (buf.st_size == 0)
+    { /* mmap(2) fails on empty file. */
+      close (fd);
+      xcur2pngCheck (NULL, 0, &nimage, printProblem, cursors[i]);
+      continue;
+    }
+    map = mmap (NULL, buf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close (fd);
+    if (map == MAP_FAILED)
+    {
+      int e = errno;
+      printf ("%s: %s\n", cursors[i], strerror (e));
+      continue;
+    }
+    /* chunk headers are far apart, so reading ahead of them only reads
+     * pixels which are not needed. */
+    madvise (map, buf.st_size, MADV_RANDOM);
+    if (xcur2pngCheck (map, buf.st_size, &nimage, printProblem,
+                       cursors[i]) == 0)
+    {
+      ++nvalid;
+      if (!quiet)
+        printf ("%s: OK (%d images)\n", cursors[i], nimage);
+    }
+    munmap (map, buf.st_size);
+  }
+  fflush (stdout);
+  if (!quiet)
+    fprintf (stderr, "\nChecking done!(%d of %d Xcursors are valid.)\n",
+             nvalid, ncursors);
+  return (nvalid == ncursors) ? 0 : 1;
+}
+
+int main (int argc, char *argv[])
+{
   int ret_val = 0;
   char *argconf = NULL;         /* config-file gotten from argv */
-  char *conf;                   /* path of config-file generated by argconf */
-  const char *cursor = NULL;    /* path to source Xcursor file */
-  const char *raw_name = NULL;  /* raw file name of Xcursor */
+  char **args = NULL;           /* Xcursors and directories gotten from argv */
+  int nargs = 0;
+  char **cursors;               /* paths to source Xcursor files */
+  int ncursors = 0;
   char *out = NULL;             /* output directory */
   char *cwd;                    /* current directory */
   int suffix = 0;               /* initial suffix */
-  FILE *conf_strm = NULL;       /* stream to config-file */
-  char *prefix;                 /* prefix which is prepended to 
-                                   PNG image name of config-file */
-  XcursorImages *xcIs = NULL;
+  int jobs = 1;                 /* number of Xcursors converted at once */
+  int *primary;                 /* Xcursor which each Xcursor is alias of */
+  int naliases = 0;
+  convContext *ctxs;            /* a conversion context for each job */
+  int allocations = 0;
+  size_t peakBytes = 0;
+  struct stat buf;
+  int i;
   /*
    * handle command line options.
    */
-  parseOptions (argc, argv, &argconf, &out, &suffix, &cursor);
-
-  /* set raw_name */
-  raw_name = rawName (cursor);
-
-  /* set conf name */
-  conf = makeConfPath (argconf, raw_name);
-  /* If is ensured that conf is not NULL */
-  /* open stream of conf */
-  conf_strm = openConfStream (conf);
-  /* If is ensured that conf_strm is opened and writable. */
+  xcur2pngInitOptions (&conv_options);
+  parseOptions (argc, argv, &argconf, &out, &suffix, &jobs, &args, &nargs);
+  removeLastSlash (argconf);
+  if (serve_socket)
+  { /* Xcursors, config-files and directories are given by requests. */
+    serve (jobs);
+    exit (1);
+  }
 
   /* set output directory path */
   if (!out)
@@ -769,29 +4443,174 @@ int main (int argc, char *argv[])
     out = ".";
   }
   removeLastSlash (out);
-  /* Is output directory is realy directory and writable? */
-  dirIsWritable (out);
+  /* Is output directory is realy directory and writable?
+   * It is only a name in archive if --archive is given. */
+  if (archive.format == ARCHIVE_NONE && !check)
+    dirIsWritable (out);
+  if (store_dir)
+  { /* umask(2) can be read only by setting it, so it is read before
+     * threads start. */
+    store_umask = umask (0);
+    umask (store_umask);
+  }
 
-  /* Read Xcursor from file specified in argument. */
-  xcIs = XcursorFilenameLoadAllImages (cursor);
-  if (!xcIs)
+  if (reverse)
+  { /* build an Xcursor from each config-file. */
+    batch = (nargs > 1);
+    for (i = 0; i < nargs; ++i)
+    {
+      ret_val += buildXcursor (args[i], out, jobs);
+    }
+    if (nargs > 1)
+      fprintf (stderr, "\nBuilding successfully done!(%d of %d cursors were built.)\n",
+               ret_val, nargs);
+    if (stats_strm && stats_strm != stderr && stats_strm != stdout)
+      fclose (stats_strm);
+    return (ret_val == nargs) ? 0 : 1;
+  }
+
+  cursors = expandCursors (args, nargs, &ncursors);
+  if (ncursors == 0)
   {
-    fprintf (stderr, "Can't load Xcursor file \"%s\"!\n", cursor);
+    fprintf (stderr, "No Xcursor is found!\n");
+    exit (1);
+  }
+  if (check)
+    exit (checkCursors (cursors, ncursors));
+  if (nargs > 1 || ncursors > 1 ||
+      (stat (args[0], &buf) == 0 && S_ISDIR (buf.st_mode)))
+  {
+    batch = 1;
+  }
+  if (batch && argconf && strcmp (argconf, "-") != 0 &&
+      !(stat (argconf, &buf) == 0 && S_ISDIR (buf.st_mode)))
+  {
+    fprintf (stderr, "\"%s\" must be a directory to convert multiple Xcursors!\n", argconf);
+    exit (2);
+  }
+  if (argconf && strcmp (argconf, "-") == 0)
+  { /* configs written to stdout must not be mixed. */
+    jobs = 1;
+  }
+  primary = malloc (ncursors * sizeof (int));
+  if (!primary)
+  {
+    fprintf (stderr, "Cannot allocate memory\n");
     exit (1);
   }
+  if (batch && !(argconf && strcmp (argconf, "-") == 0))
+    naliases = findAliases (cursors, ncursors, primary);
+  else
+  { /* config-file written to stdout cannot be linked. */
+    for (i = 0; i < ncursors; ++i)
+      primary[i] = i;
+  }
+
   /* OK, all condition is good ! */
   /* get current directory */
   cwd = getcwd (NULL, 0);
-  /* Let's get path from conf to directory where PNG images are written. */
-  prefix = getPrefixFromConfToOut (conf, out, cwd);
-  /* then write conf and PNGs */
-  ret_val = saveConfAndPNGs (xcIs, raw_name, suffix, conf_strm, prefix, out);
+  if (incremental)
+    loadManifest (out, cwd, suffix);
+  /* archive has its own order of entries, so it is written by encoders. */
+  if (write_threads > 0 && !dry_run && archive.format == ARCHIVE_NONE &&
+      !connect_socket)
+    startWriter (write_threads);
+  ctxs = malloc (jobs * sizeof (convContext));
+  if (!ctxs)
+  {
+    fprintf (stderr, "Cannot allocate memory\n");
+    exit (1);
+  }
+  for (i = 0; i < jobs; ++i)
+  {
+    initConvContext (ctxs + i);
+  }
+  if (!batch && !connect_socket)
+  {
+    ret_val = convertCursor (cursors[0], argconf, out, NULL, suffix, cwd, ctxs,
+                             jobs);
+  }
+  else
+  {
+    batchArgs b;
+    b.cursors = cursors;
+    b.argconf = argconf;
+    b.out = out;
+    b.suffix = suffix;
+    b.cwd = cwd;
+    b.ctxs = ctxs;
+    b.results = calloc (ncursors, sizeof (int));
+    if (!b.results)
+    {
+      fprintf (stderr, "Cannot allocate memory\n");
+      exit (1);
+    }
+    b.primary = primary;
+    b.ncursors = ncursors;
+    b.done = 0;
+    pthread_mutex_init (&b.lock, NULL);
+    if (batch)
+      VERBOSE_PRINT ("Converting %d cursors...\n", ncursors);
+    if (connect_socket)
+    { /* each worker sends Xcursors to server through its own connection. */
+      connectServer (&b, jobs < ncursors ? jobs : ncursors);
+      runJobs (ncursors, jobs, convertRemoteJob, &b);
+      disconnectServer (&b, jobs < ncursors ? jobs : ncursors);
+    }
+    else
+      runJobs (ncursors, jobs, convertBatchJob, &b);
+    pthread_mutex_destroy (&b.lock);
+    ret_val = 0;
+    for (i = 0; i < ncursors; ++i)
+    {
+      if (primary[i] != i)
+        b.results[i] = b.results[primary[i]] &&
+                       linkAlias (cursors[i], cursors[primary[i]], argconf);
+      ret_val += b.results[i];
+    }
+    fprintf (stderr, "\nConversion successfully done!(%d of %d cursors were converted.)\n",
+             ret_val, ncursors);
+    if (naliases)
+      VERBOSE_PRINT ("(%d of them were aliases of other cursors and linked.)\n",
+                     naliases);
+    ret_val = (ret_val == ncursors);
+    free (b.results);
+  }
+  for (i = 0; i < jobs; ++i)
+  {
+    allocations += ctxs[i].allocations;
+    peakBytes += ctxs[i].peakBytes;
+    freeConvContext (ctxs + i);
+  }
+  if (stats_strm)
+  { /* totals of all workers, which per-cursor statistics do not show. */
+    VERBOSE_PRINT ("(%d buffer allocations, %lu bytes of buffers at peak.)\n",
+                   allocations, (unsigned long) peakBytes);
+  }
+  stopWriter ();
+  if (incremental)
+  { /* Xcursors which are not converted this time are kept in manifest. */
+    if (!saveManifest ())
+      ret_val = 0;
+    for (i = 0; i < manifest.nentry; ++i)
+      freeManifestEntry (manifest.entries + i);
+    free (manifest.entries);
+    free (manifest.path);
+    free (manifest.options);
+  }
   /* free memory */
-  XcursorImagesDestroy(xcIs);
-  fclose (conf_strm);
-  free (conf);
+  free (ctxs);
+  free (primary);
+  for (i = 0; i < ncursors; ++i)
+  {
+    free (cursors[i]);
+  }
+  free (cursors);
   free (cwd);
-  free (prefix);
+  if (stats_strm && stats_strm != stderr && stats_strm != stdout)
+    fclose (stats_strm);
+  if (archive.format != ARCHIVE_NONE && !finishArchive ())
+    ret_val = 0;
   if (!ret_val)
   {
     exit (1);
@@ -9,7 +9,7 @@ URL:            http://www.sutv.zaq.ne.jp/linuz/tks/
 Source0:        http://www.sutv.zaq.ne.jp/linuz/tks/item/%{name}-%{version}.tar.gz
 BuildRoot:      %{_tmppath}/%{name}-%{version}-%{release}-root-%(%{__id_u} -n)
 
-BuildRequires:  pkgconfig libpng-devel libXcursor-devel
+BuildRequires:  pkgconfig libpng-devel libXcursor-devel zlib-devel
 
 %description
 xcur2png is a program which let you take PNG image from X cursor,
@@ -38,6 +38,8 @@ rm -rf $RPM_BUILD_ROOT
 %defattr(-,root,root,-)
 %doc COPYING ChangeLog README
 %{_bindir}/xcur2png
+%{_libdir}/libxcur2png.a
+%{_includedir}/libxcur2png.h
 %{_mandir}/man1/xcur2png.1*
 
 